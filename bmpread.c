@@ -29,6 +29,7 @@
 
 #include "bmpread.h"
 
+#include <float.h>
 #include <limits.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -56,6 +57,41 @@
 /* Default value for alpha when none is present in the file. */
 #define BMPREAD_DEFAULT_ALPHA 255
 
+/* The standard library allocator, which we use unless told otherwise.
+ */
+static void * DefaultAllocate(size_t size, void * user)
+{
+    (void)user; /* Unused. */
+    return malloc(size);
+}
+
+static void DefaultDeallocate(void * ptr, void * user)
+{
+    (void)user; /* Unused. */
+    free(ptr);
+}
+
+/* The allocator set by bmpread_set_allocator().
+ */
+static bmpread_allocator_t global_allocator =
+{
+    DefaultAllocate, DefaultDeallocate, NULL
+};
+
+/* Allocates memory with the given allocator.  Returns NULL if out of memory.
+ */
+static void * Allocate(const bmpread_allocator_t * p_alloc, size_t size)
+{
+    return p_alloc->allocate(size, p_alloc->user);
+}
+
+/* Frees memory, which must not be NULL, with the allocator that allocated it.
+ */
+static void Deallocate(const bmpread_allocator_t * p_alloc, void * ptr)
+{
+    p_alloc->deallocate(ptr, p_alloc->user);
+}
+
 /* I've tried to make every effort to remove the possibility of undefined
  * behavior and prevent related errors where maliciously crafted files could
  * lead to buffer overflows or the like.  To that end, we'll start with some
@@ -354,13 +390,14 @@ static int ParseBitfield(bitfield * field, uint32_t mask)
 }
 
 /* A single color entry in the palette, in file order (BGR + one unused byte).
+ * We keep each entry's alpha in place of the unused byte.
  */
 typedef struct bmp_color
 {
     uint8_t blue;
     uint8_t green;
     uint8_t red;
-    uint8_t unused;
+    uint8_t alpha;
 
 } bmp_color;
 
@@ -391,14 +428,159 @@ static int ReadPalette(bmp_color * palette, int colors, FILE * fp)
         if(fread(components, 1, sizeof(components), fp) != sizeof(components))
             return 0;
 
-        palette[i].blue   = components[0];
-        palette[i].green  = components[1];
-        palette[i].red    = components[2];
-        palette[i].unused = components[3];
+        palette[i].blue  = components[0];
+        palette[i].green = components[1];
+        palette[i].red   = components[2];
     }
     return 1;
 }
 
+/* Computes the luma of a color, weighting components as in ITU-R BT.601.  The
+ * weights add up to 256, so white stays white.
+ */
+#define Luma(red, green, blue) \
+    ((77 * (uint32_t)(red) + 150 * (uint32_t)(green) + \
+      29 * (uint32_t)(blue) + 128) >> 8)
+
+/* Replaces each color in the palette with its luma, in all three components,
+ * so indexed images can be decoded to grayscale with a single lookup per
+ * pixel.
+ */
+static void MakePaletteGray(bmp_color * palette, uint32_t colors)
+{
+    uint32_t i;
+    for(i = 0; i < colors; i++)
+    {
+        uint8_t luma = (uint8_t)Luma(palette[i].red, palette[i].green,
+                                     palette[i].blue);
+        palette[i].red = palette[i].green = palette[i].blue = luma;
+    }
+}
+
+/* Sets the alpha of each color in the palette: 0 for the key color if keyed is
+ * nonzero, or BMPREAD_DEFAULT_ALPHA otherwise.  The key is 0xRRGGBB.
+ */
+static void SetPaletteAlpha(bmp_color * palette,
+                            uint32_t colors,
+                            int keyed,
+                            uint32_t key)
+{
+    uint32_t i;
+    for(i = 0; i < colors; i++)
+    {
+        uint32_t rgb = ((uint32_t)palette[i].red << 16) |
+                       ((uint32_t)palette[i].green << 8) | palette[i].blue;
+
+        palette[i].alpha = ((keyed && rgb == key) ? 0 : BMPREAD_DEFAULT_ALPHA);
+    }
+}
+
+/* Premultiplies each color in the palette by the alpha SetPaletteAlpha() gave
+ * it, which just turns the transparent ones black.
+ */
+static void PremultiplyPalette(bmp_color * palette, uint32_t colors)
+{
+    uint32_t i;
+    for(i = 0; i < colors; i++)
+    {
+        if(!palette[i].alpha)
+            palette[i].red = palette[i].green = palette[i].blue = 0;
+    }
+}
+
+/* Replaces each color in the palette with what the given lookup tables, one
+ * each for red, green, and blue, map it to.
+ */
+static void ApplyPaletteLut(bmp_color * palette,
+                            uint32_t colors,
+                            const uint8_t (* lut)[256])
+{
+    uint32_t i;
+    for(i = 0; i < colors; i++)
+    {
+        palette[i].red   = lut[0][palette[i].red];
+        palette[i].green = lut[1][palette[i].green];
+        palette[i].blue  = lut[2][palette[i].blue];
+    }
+}
+
+/* The buffers a read_context allocates, which a bmpread_ctx_t keeps around to
+ * reuse between reads.
+ */
+#define BUFFER_PALETTE   0
+#define BUFFER_FILE_DATA 1
+#define BUFFER_LINE      2
+#define BUFFER_SUMS      3
+#define BUFFER_DATA_OUT  4
+#define BUFFER_PALETTE_OUT 5
+#define BUFFER_BAND      6
+#define BUFFER_RING      7
+#define BUFFER_ACROSS    8 /* And 9, for its first pixels. */
+#define BUFFER_DOWN      10 /* And 11. */
+#define BUFFER_CRC       12
+#define BUFFER_STATS     13
+#define BUFFER_COUNT     14
+
+/* One of the above buffers, and how big it is.
+ */
+typedef struct reusable_buffer
+{
+    void   * data;
+    size_t   size;
+
+} reusable_buffer;
+
+/* The state behind a bmpread_ctx_t.  The context itself was allocated with
+ * its allocator, too.
+ */
+struct bmpread_ctx_t
+{
+    reusable_buffer     buffers[BUFFER_COUNT];
+    bmpread_allocator_t allocator;
+    uint8_t             lut[3][256]; /* Set by bmpread_ctx_set_lut(). */
+    int                 has_lut;
+    uint32_t            color_key; /* Set by bmpread_ctx_set_color_key(). */
+    int                 has_color_key;
+};
+
+/* How one axis of the image is resampled, by bmpread_resized().  Each output
+ * pixel is a weighted sum of taps input pixels in a row, starting at first.
+ */
+typedef struct resample_filter
+{
+    int32_t * first;   /* First input pixel of each output pixel. */
+    float   * weights; /* taps weights for each output pixel. */
+    int32_t   taps;    /* How many input pixels each output pixel sums. */
+
+} resample_filter;
+
+/* Most mipmap levels an image can have: one for each bit of its size. */
+#define MAX_LEVELS 32
+
+/* Where one mipmap level is in the output, and its size.
+ */
+typedef struct mipmap_level
+{
+    size_t    offset;    /* Bytes from the start of the output. */
+    int32_t   width;     /* Width in pixels. */
+    int32_t   lines;     /* Height in pixels. */
+    size_t    line_len;  /* Bytes in each line. */
+    size_t    plane_len; /* Bytes in each plane, or the whole level. */
+
+} mipmap_level;
+
+struct read_context;
+
+/* Decodes one scan line of file data into output pixels.  Takes a pointer to
+ * an output buffer scan line (p_out), a pointer to the end of the *pixel data*
+ * of this scan line (p_out_end), a pointer to the source scan line of file
+ * data (p_file), and our context.  See the Decode*() functions below.
+ */
+typedef void (* line_decoder)(uint8_t * p_out,
+                              const uint8_t * p_out_end,
+                              const uint8_t * p_file,
+                              const struct read_context * p_ctx);
+
 /* Context shared between the below functions.
  */
 typedef struct read_context
@@ -410,16 +592,426 @@ typedef struct read_context
     uint32_t       headers_size;  /* Total size of header + info. */
     uint32_t       after_headers; /* Size of space for palette. */
     int32_t        lines;         /* How many scan lines (abs(height)). */
+    int32_t        x;             /* First column we decode. */
+    int32_t        y;             /* First row we decode, in output order. */
+    int32_t        region_width;  /* Columns we decode, or 0 for all. */
+    int32_t        region_lines;  /* Rows we decode. */
+    unsigned int   scale_shift;   /* log2 of how much we scale down by. */
+    int32_t        scale;         /* How much we scale down by (1, 2, 4, 8). */
+    int32_t        out_width;     /* Width of the output (scaled region). */
+    int32_t        out_lines;     /* Height of the output. */
+    int            mirror;        /* Whether lines are output right to left. */
+    int            flip;          /* Whether lines go in the other order. */
+    int            transpose;     /* Whether output rows are columns above. */
+    int32_t        image_width;   /* Width of the output, after transposing. */
+    int32_t        image_lines;   /* Height of it. */
+    int32_t        pad_width;     /* Width of the output, padded. */
+    int32_t        pad_lines;     /* Height of it. */
+    int32_t        target_width;  /* Width to resize to, or 0 to not. */
+    int32_t        target_lines;  /* Height to resize to. */
+    resample_filter across;       /* How lines are resized. */
+    resample_filter down;         /* How columns are resized. */
+    float        * ring;          /* down.taps resized lines, round robin. */
+    int            levels;        /* How many mipmap levels we output. */
+    mipmap_level   mipmaps[MAX_LEVELS]; /* Where each of them goes. */
+    size_t         x_step;        /* Pixels to advance in file per output. */
     size_t         file_line_len; /* How many bytes each scan line is. */
-    size_t         out_channels;  /* Output color channels (3, or 4=alpha). */
+    size_t         span_offset;   /* Where our columns start in a scan line. */
+    size_t         span_len;      /* How many bytes of each line we read. */
+    unsigned int   skip_pixels;   /* Pixels to skip in a span's first byte. */
+    size_t         out_channels;  /* Output channels (1-4). */
+    size_t         channel_pos[4]; /* Where R, G, B, A come in output order. */
+    size_t         out_planes;    /* How many planes (1, or out_channels). */
+    size_t         plane_len;     /* Bytes between planes, or 0 if just 1. */
+    size_t         channel_at[4]; /* Where decoders put R, G, B, A in a
+                                   * pixel. */
+    size_t         pixel_step;    /* Bytes from one decoded pixel to the
+                                   * next. */
+    int            out_alpha;     /* Whether we output alpha. */
+    int            gray;          /* Whether we output luma, not colors. */
+    size_t         out_depth;     /* Bytes per output component (1, 2, 4). */
+    unsigned int   comp_bits;     /* Bits decoders make each component (8,
+                                   * 16). */
+    uint32_t       byte_scale;    /* Turns an 8-bit component into
+                                   * comp_bits. */
+    uint32_t       default_alpha; /* BMPREAD_DEFAULT_ALPHA in comp_bits. */
+    int            linear;        /* Whether we convert colors to linear. */
+    int            premultiply;   /* Whether we multiply colors by alpha. */
+    const uint8_t (* lut)[256];   /* Tables for R, G, B, or NULL for none. */
+    int            keyed;         /* Whether a color key sets alpha. */
+    int            drop_alpha;    /* Whether alpha's all full so far, and is
+                                   * to be dropped if it stays that way. */
+    int            scan_alpha;    /* Whether each line's alpha has to be
+                                   * checked to know that. */
+    uint32_t       color_key;     /* That color, as 0xRRGGBB. */
+    int            direct;        /* Whether palette bytes go straight out. */
+    float          to_linear[256]; /* Linear value of each 8-bit sRGB value. */
     size_t         out_line_len;  /* Bytes in each output line. */
+    size_t         out_plane_len; /* Bytes in each output plane, or 0. */
+    int            in_place;      /* Whether we decode within output lines. */
+    size_t         in_place_offset; /* Where in them we read spans to. */
+    int            raw;           /* Whether the file's pixels need no
+                                   * decoding. */
     bitfield       bitfields[4];  /* How to decode 16- and 32-bits. */
     bmp_color    * palette;       /* Enough entries for our bit depth. */
     uint8_t      * file_data;     /* A line of data in the file. */
     uint8_t      * data_out;      /* RGB(A) data output buffer. */
+    uint8_t      * palette_out;   /* Palette handed out with indexed output. */
+    uint32_t       palette_colors; /* How many entries it has. */
+    uint8_t      * line;          /* Unscaled line, for averaging. */
+    uint8_t      * band;          /* Lines waiting to be transposed or
+                                   * resized. */
+    uint32_t     * sums;          /* Running sums of each output component
+                                   * (floats, with BMPREAD_FLOAT). */
+    line_decoder   decoder;       /* Decode*() function for our bit depth. */
+    reusable_buffer * buffers;    /* BUFFER_* buffers to reuse, or NULL. */
+    bmpread_allocator_t allocator; /* Allocates everything above. */
+    uint8_t      * scratch;       /* Caller's memory for buffers, or NULL. */
+    size_t         scratch_left;  /* How much of it is still unused. */
+    uint8_t      * caller_out;    /* Caller's memory for data_out, or NULL. */
+    size_t         caller_out_len; /* How big it is. */
+    int32_t        next_line;     /* File line the fp is at, or -1 if
+                                   * unknown. */
+    uint32_t     * crc_table;     /* Slicing-by-4 CRC-32C tables, or NULL if
+                                   * we aren't hashing. */
+    uint32_t     * crc_shifts;    /* Matrices that shift a CRC past 2^n
+                                   * lines. */
+    size_t         crc_line_len;  /* Bytes hashed in each line of each
+                                   * plane. */
+    uint32_t       checksum;      /* Shifted CRCs of the lines so far, or
+                                   * once they're all done, the CRC of all
+                                   * of them. */
+    bmpread_stats_t * stats;      /* Statistics we gather, or NULL. */
+    unsigned long * index_counts; /* How many of each index, when indexed. */
 
 } read_context;
 
+/* The strictest alignment of anything we put in a buffer, or a multiple of it.
+ * Carving scratch memory into pieces that are multiples of this size keeps
+ * them all as aligned as the start of the scratch memory.
+ */
+typedef union max_align
+{
+    uint32_t   u32;
+    double     d;
+    void     * p;
+
+} max_align;
+
+/* Takes size bytes from the start of the caller's scratch memory.  Returns
+ * NULL if there isn't enough left.
+ */
+static void * TakeScratch(read_context * p_ctx, size_t size)
+{
+    uint8_t * data = p_ctx->scratch;
+
+    /* Round up to keep the next piece aligned. */
+    size_t pad = (sizeof(max_align) - size % sizeof(max_align)) %
+                 sizeof(max_align);
+
+    if(!CanAdd(size, pad) || size + pad > p_ctx->scratch_left) return NULL;
+
+    p_ctx->scratch      += size + pad;
+    p_ctx->scratch_left -= size + pad;
+    return data;
+}
+
+/* Allocates size bytes for the given BUFFER_* buffer, filled with 0 if zero is
+ * nonzero.  When the context has buffers to reuse, the existing one is handed
+ * back instead if it's big enough, and is replaced (not freed by
+ * FreeContext()) if it isn't.  When the caller supplied memory, it's used
+ * instead, and we never fall back to the allocator.  Returns NULL if out of
+ * memory.
+ */
+static void * AllocateBuffer(read_context * p_ctx,
+                             int which,
+                             size_t size,
+                             int zero)
+{
+    reusable_buffer * p_buf;
+
+    void * data;
+
+    if(which == BUFFER_DATA_OUT && p_ctx->caller_out)
+        data = ((size <= p_ctx->caller_out_len) ? p_ctx->caller_out : NULL);
+    else if(p_ctx->scratch)
+        data = TakeScratch(p_ctx, size);
+    else if(!p_ctx->buffers)
+        data = Allocate(&p_ctx->allocator, size);
+    else
+    {
+        p_buf = &p_ctx->buffers[which];
+        if(p_buf->size < size)
+        {
+            /* We don't need to keep the contents, so there's no need for
+             * anything like realloc().
+             */
+            if(p_buf->data)
+                Deallocate(&p_ctx->allocator, p_buf->data);
+            p_buf->size = 0;
+
+            if(!(p_buf->data = Allocate(&p_ctx->allocator, size))) return NULL;
+            p_buf->size = size;
+        }
+        data = p_buf->data;
+    }
+
+    if(data && zero)
+        memset(data, 0, size);
+    return data;
+}
+
+/* Converts an sRGB component in [0, 1] to linear light, with the standard
+ * sRGB transfer function.  This only runs when building a table, and avoids
+ * libm: x^2.4 is x^2 times the fifth root of x^2, which Newton's method finds
+ * in a few steps, since x^2 is never far from 1 here.
+ */
+static float SrgbToLinear(double x)
+{
+    double square;
+    double root = 1.0;
+    int    i;
+
+    if(x <= 0.04045)
+        return (float)(x / 12.92);
+
+    x = (x + 0.055) / 1.055;
+    square = x * x;
+
+    /* Starting above the root, this only ever closes in on it. */
+    for(i = 0; i < 16; i++)
+        root = (4.0 * root + square / (root * root * root * root)) / 5.0;
+
+    return (float)(square * root);
+}
+
+/* Fills in the context's table of linear values for each 8-bit component.
+ */
+static void BuildLinearTable(read_context * p_ctx)
+{
+    int i;
+    for(i = 0; i < 256; i++)
+        p_ctx->to_linear[i] = SrgbToLinear(i / 255.0);
+}
+
+/* Returns the linear value of a component made by the decoders, interpolating
+ * between table entries for 16-bit components.  Every multiple of 257 is an
+ * 8-bit value, exactly.
+ */
+static float Linearize(const read_context * p_ctx, uint32_t value)
+{
+    uint32_t i;
+    uint32_t rem;
+
+    if(p_ctx->comp_bits == 8)
+        return p_ctx->to_linear[value];
+
+    i   = value / 257;
+    rem = value % 257;
+    if(!rem)
+        return p_ctx->to_linear[i];
+
+    /* i is at most 254 here, since 65535 is a multiple of 257. */
+    return p_ctx->to_linear[i] + (p_ctx->to_linear[i + 1] -
+                                  p_ctx->to_linear[i]) * (float)rem / 257;
+}
+
+/* Returns a component made by the decoders looked up in one of the LUT's
+ * tables, interpolating between entries for 16-bit components the same way
+ * Linearize does, so an identity table leaves every component unchanged.
+ */
+static uint32_t LookUp(const read_context * p_ctx,
+                       const uint8_t * table,
+                       uint32_t value)
+{
+    uint32_t i;
+    uint32_t rem;
+
+    if(p_ctx->comp_bits == 8)
+        return table[value];
+
+    i   = value / 257;
+    rem = value % 257;
+    if(!rem)
+        return table[i] * UINT32_C(257);
+
+    /* i is at most 254 here, since 65535 is a multiple of 257.  The result
+     * stays between the two entries' 16-bit values, so it can't overflow.
+     */
+    if(table[i + 1] >= table[i])
+        return table[i] * UINT32_C(257) +
+               (uint32_t)(table[i + 1] - table[i]) * rem;
+    return table[i] * UINT32_C(257) -
+           (uint32_t)(table[i] - table[i + 1]) * rem;
+}
+
+/* Multiplies a component by alpha, both with the given number of bits (8 or
+ * 16), rounding to the nearest value exactly as (color * alpha) / (2^bits - 1)
+ * would, without dividing.  Neither the product nor the sum can overflow.
+ */
+static uint32_t Premultiply(uint32_t color, uint32_t alpha, unsigned int bits)
+{
+    uint32_t t = color * alpha + (UINT32_C(1) << (bits - 1));
+    return (t + (t >> bits)) >> bits;
+}
+
+/* Stores one component, made by the decoders with comp_bits bits, at p in the
+ * output's component format.  p is aligned for the component type, since
+ * buffers are, and components are all the same size.
+ */
+static void StoreComponent(uint8_t * p,
+                           const read_context * p_ctx,
+                           uint32_t value)
+{
+    if(p_ctx->out_depth == 1)
+        *p = (uint8_t)value;
+    else if(p_ctx->out_depth == 2)
+        *(uint16_t *)(void *)p = (uint16_t)value;
+    else
+        *(float *)(void *)p = (float)value / 65535;
+}
+
+/* Stores a linear light value from 0 to 1 at p, as with StoreComponent().
+ */
+static void StoreLinear(uint8_t * p, const read_context * p_ctx, float linear)
+{
+    if(p_ctx->out_depth == 1)
+        *p = (uint8_t)(linear * 255 + 0.5f);
+    else if(p_ctx->out_depth == 2)
+        *(uint16_t *)(void *)p = (uint16_t)(linear * 65535 + 0.5f);
+    else
+        *(float *)(void *)p = linear;
+}
+
+/* Stores a pixel's components, made by the decoders with comp_bits bits,
+ * wherever the output format puts them, storing just the color's luma for
+ * grayscale output.  A color key, if any, decides alpha from the color's top 8
+ * bits as the file has it.  Colors go through the caller's lookup tables
+ * next, if any, interpolating between entries for 16-bit components.  Then
+ * they're premultiplied by alpha and converted to linear light if asked,
+ * premultiplying after the conversion, where blending happens.  Alpha goes
+ * last, so for alpha only output, where every channel is in the same place,
+ * it's what ends up there.
+ */
+static void StorePixel(uint8_t * p_out,
+                       const read_context * p_ctx,
+                       uint32_t red,
+                       uint32_t green,
+                       uint32_t blue,
+                       uint32_t alpha)
+{
+    const size_t * at = p_ctx->channel_at;
+
+    if(p_ctx->keyed)
+    {
+        unsigned int shift = p_ctx->comp_bits - 8;
+        uint32_t     rgb   = ((red   >> shift) << 16) |
+                             ((green >> shift) <<  8) | (blue >> shift);
+
+        alpha = ((rgb == p_ctx->color_key) ? 0 : p_ctx->default_alpha);
+    }
+
+    if(p_ctx->lut)
+    {
+        red   = LookUp(p_ctx, p_ctx->lut[0], red);
+        green = LookUp(p_ctx, p_ctx->lut[1], green);
+        blue  = LookUp(p_ctx, p_ctx->lut[2], blue);
+    }
+
+    if(p_ctx->gray)
+        red = Luma(red, green, blue);
+
+    if(p_ctx->premultiply && !p_ctx->linear)
+    {
+        red = Premultiply(red, alpha, p_ctx->comp_bits);
+        if(!p_ctx->gray)
+        {
+            green = Premultiply(green, alpha, p_ctx->comp_bits);
+            blue  = Premultiply(blue,  alpha, p_ctx->comp_bits);
+        }
+    }
+
+    if(p_ctx->direct)
+    {
+        /* The usual case, byte for byte. */
+        p_out[at[0]] = (uint8_t)red;
+        if(!p_ctx->gray)
+        {
+            p_out[at[1]] = (uint8_t)green;
+            p_out[at[2]] = (uint8_t)blue;
+        }
+        if(p_ctx->out_alpha)
+            p_out[at[3]] = (uint8_t)alpha;
+        return;
+    }
+
+    if(p_ctx->linear)
+    {
+        float coverage = 1.0f;
+        if(p_ctx->premultiply)
+            coverage = (float)alpha /
+                       (float)((UINT32_C(1) << p_ctx->comp_bits) - 1);
+
+        StoreLinear(p_out + at[0], p_ctx, Linearize(p_ctx, red) * coverage);
+        if(!p_ctx->gray)
+        {
+            StoreLinear(p_out + at[1], p_ctx,
+                        Linearize(p_ctx, green) * coverage);
+            StoreLinear(p_out + at[2], p_ctx,
+                        Linearize(p_ctx, blue) * coverage);
+        }
+    }
+    else
+    {
+        StoreComponent(p_out + at[0], p_ctx, red);
+        if(!p_ctx->gray)
+        {
+            StoreComponent(p_out + at[1], p_ctx, green);
+            StoreComponent(p_out + at[2], p_ctx, blue);
+        }
+    }
+
+    /* Alpha is never converted. */
+    if(p_ctx->out_alpha)
+        StoreComponent(p_out + at[3], p_ctx, alpha);
+}
+
+/* Stores a palette entry as a pixel, as with StorePixel().  For grayscale
+ * output the palette is already gray, so in the usual case its bytes can go
+ * straight out.
+ */
+static void StorePaletteColor(uint8_t * p_out,
+                              const read_context * p_ctx,
+                              const bmp_color * color)
+{
+    const size_t * at    = p_ctx->channel_at;
+    uint32_t       scale = p_ctx->byte_scale;
+
+    if(p_ctx->direct)
+    {
+        p_out[at[0]] = color->red;
+        p_out[at[1]] = color->green;
+        p_out[at[2]] = color->blue;
+        if(p_ctx->out_alpha)
+            p_out[at[3]] = color->alpha;
+        return;
+    }
+
+    StorePixel(p_out, p_ctx, color->red * scale, color->green * scale,
+               color->blue * scale, color->alpha * scale);
+}
+
+/* Called by ValidateBitfields() for files with no alpha of their own and no
+ * color key, whose output alpha is all the default.  There's nothing to
+ * premultiply by, and whether alpha can be dropped is known up front.
+ */
+static void ValidateOpaque(read_context * p_ctx)
+{
+    p_ctx->premultiply = 0;
+    p_ctx->drop_alpha  = (p_ctx->drop_alpha && BMPREAD_DEFAULT_ALPHA == 255);
+    p_ctx->scan_alpha  = 0;
+}
+
 /* A sub-function to Validate() that handles the bitfields.  Returns 0 on
  * invalid bitfields or nonzero on success.  Note that we don't treat odd
  * bitmasks such as R8G8 or A1G1B1 as invalid, even though they may not load in
@@ -434,8 +1026,15 @@ static int ValidateBitfields(read_context * p_ctx)
 
     int i;
 
+    /* Other files are opaque, unless a color key makes some of it
+     * transparent.
+     */
     if(p_ctx->info.compression != COMPRESSION_BITFIELDS)
+    {
+        if(!p_ctx->keyed)
+            ValidateOpaque(p_ctx);
         return 1;
+    }
 
     for(i = 0; i < 4; i++)
     {
@@ -454,6 +1053,9 @@ static int ValidateBitfields(read_context * p_ctx)
     /* Check for contiguous-ity between fields, too. */
     if(!ParseBitfield(&total_field, total_mask)) return 0;
 
+    if(!bf[3].span && !p_ctx->keyed)
+        ValidateOpaque(p_ctx);
+
     return 1;
 }
 
@@ -482,12 +1084,97 @@ static int ValidateAndReadPalette(read_context * p_ctx)
      * lookups beyond the file's palette get set to black.
      */
     if(!(p_ctx->palette = (bmp_color *)
-         calloc(colors, sizeof(p_ctx->palette[0])))) return 0;
+         AllocateBuffer(p_ctx, BUFFER_PALETTE,
+                        colors * sizeof(p_ctx->palette[0]), 1))) return 0;
 
     if(!CanMakeLong(p_ctx->headers_size))                    return 0;
     if(fseek(p_ctx->fp, p_ctx->headers_size, SEEK_SET))      return 0;
     if(!ReadPalette(p_ctx->palette, file_colors, p_ctx->fp)) return 0;
 
+    /* Every pixel's color comes from the palette, so keying, looking up and
+     * premultiplying its colors once here means the decoders never need to.
+     * This goes in the same order StorePixel() does: the key matches the
+     * file's colors, so it goes first, and premultiplying goes last.
+     */
+    SetPaletteAlpha(p_ctx->palette, colors, p_ctx->keyed, p_ctx->color_key);
+    p_ctx->keyed = 0;
+
+    if(p_ctx->lut)
+    {
+        ApplyPaletteLut(p_ctx->palette, colors, p_ctx->lut);
+        p_ctx->lut = NULL;
+    }
+
+    if(p_ctx->gray)
+        MakePaletteGray(p_ctx->palette, colors);
+
+    if(p_ctx->premultiply)
+    {
+        PremultiplyPalette(p_ctx->palette, colors);
+        p_ctx->premultiply = 0;
+    }
+
+    return 1;
+}
+
+/* A sub-function to Validate() that handles BMPREAD_INDEXED.  Writes out the
+ * palette in the output format the flags ask for, then switches the context
+ * over to outputting a single byte per pixel, with an identity palette so the
+ * decoders look up each pixel's index as its own value.  Returns 0 on invalid
+ * flags for this file or out of memory, or nonzero on success.
+ */
+static int ValidateIndexed(read_context * p_ctx)
+{
+    size_t   entry_len;
+    uint32_t colors;
+    uint32_t i;
+
+    if(!(p_ctx->flags & BMPREAD_INDEXED)) return 1;
+
+    /* Only palette files have indices, and averaging them means nothing. */
+    if(p_ctx->info.bits > 8)                            return 0;
+    if((p_ctx->flags & BMPREAD_SCALE_AVERAGE) &&
+       (p_ctx->flags & BMPREAD_SCALE_8))                return 0;
+
+    /* Any index in the data is a valid lookup: entries the file left out are
+     * black, as in ValidateAndReadPalette().  This can't overflow: it's at
+     * most 256 entries of 4 components of 4 bytes.
+     */
+    colors    = UINT32_C(1) << p_ctx->info.bits;
+    entry_len = p_ctx->out_channels * p_ctx->out_depth;
+    if(!(p_ctx->palette_out = (uint8_t *)
+         AllocateBuffer(p_ctx, BUFFER_PALETTE_OUT,
+                        colors * entry_len, 0))) return 0;
+    p_ctx->palette_colors = colors;
+
+    /* Entries are stored like interleaved pixels, the same way the decoders
+     * store them.
+     */
+    for(i = 0; i < 4; i++)
+        p_ctx->channel_at[i] = p_ctx->channel_pos[i] * p_ctx->out_depth;
+
+    for(i = 0; i < colors; i++)
+    {
+        bmp_color * color = &p_ctx->palette[i];
+
+        StorePaletteColor(p_ctx->palette_out + i * entry_len, p_ctx, color);
+        color->red = color->green = color->blue = (uint8_t)i;
+    }
+
+    p_ctx->out_channels = 1;
+    p_ctx->out_alpha    = 0;
+    p_ctx->gray         = 0;
+    p_ctx->channel_pos[0] = p_ctx->channel_pos[1] = 0;
+    p_ctx->channel_pos[2] = p_ctx->channel_pos[3] = 0;
+
+    /* Indices are always single bytes, as they are. */
+    p_ctx->out_depth     = 1;
+    p_ctx->comp_bits     = 8;
+    p_ctx->byte_scale    = 1;
+    p_ctx->default_alpha = BMPREAD_DEFAULT_ALPHA;
+    p_ctx->linear        = 0;
+    p_ctx->direct        = 1;
+
     return 1;
 }
 
@@ -507,6 +1194,22 @@ static int IsPowerOf2(uint32_t x)
     return 0;
 }
 
+/* Returns the smallest power of 2 no less than a positive integer, or 0 if
+ * that doesn't fit in an int32_t.
+ */
+static int32_t NextPowerOf2(int32_t x)
+{
+    int32_t pow2 = 1;
+
+    while(pow2 < x)
+    {
+        if(pow2 > INT32_MAX / 2) return 0;
+        pow2 *= 2;
+    }
+
+    return pow2;
+}
+
 /* Returns the byte length of a scan line padded as necessary to be divisible
  * by four.  For example, 3 pixels wide at 24 bpp would yield 12 (3 pixels * 3
  * bytes each = 9 bytes, padded by 3 to the next multiple of 4).  bpp is *bits*
@@ -528,429 +1231,3425 @@ static size_t GetLineLength(size_t width, size_t bpp)
     return (bits + pad_bits) / 8;
 }
 
-/* Reads and validates the bitmap header metadata from the context's file
- * object.  Assumes the file pointer is at the start of the file.  Returns 1 if
- * ok or 0 if error or invalid file.
+/* A sub-function to Validate() that works out how to orient the output from
+ * the flags.  Every orientation comes down to three things: mirroring each
+ * line, flipping the order of the lines, and transposing, so that lines
+ * become columns.  Mirroring the image first just mirrors its lines.
+ * Turning it by 180 degrees mirrors and flips it.  Turning it by 90 degrees
+ * clockwise transposes it after flipping it when output is top down, or
+ * after mirroring it when it's bottom up.  270 is 180 then 90.
  */
-static int Validate(read_context * p_ctx)
+static void ValidateOrientation(read_context * p_ctx)
 {
-    if(!ReadHeader(&p_ctx->header, p_ctx->fp)) return 0;
-    if(!ReadInfo(  &p_ctx->info,   p_ctx->fp)) return 0;
-
-    if(p_ctx->info.info_size > UINT32_MAX - BMP_HEADER_SIZE) return 0;
-    p_ctx->headers_size = BMP_HEADER_SIZE + p_ctx->info.info_size;
+    unsigned int turns = ((p_ctx->flags & BMPREAD_ROTATE_270) /
+                          BMPREAD_ROTATE_90);
 
-    if(p_ctx->header.data_offset < p_ctx->headers_size) return 0;
-    p_ctx->after_headers = p_ctx->header.data_offset - p_ctx->headers_size;
+    p_ctx->mirror    = ((p_ctx->flags & BMPREAD_MIRROR) ? 1 : 0);
+    p_ctx->flip      = 0;
+    p_ctx->transpose = (int)(turns & 1);
 
-    if(p_ctx->info.width <= 0 || p_ctx->info.height == 0) return 0;
+    if(turns & 2)
+    {
+        p_ctx->mirror = !p_ctx->mirror;
+        p_ctx->flip   = 1;
+    }
 
-    if(!CanMakeSizeT(p_ctx->info.width))  return 0;
-    if(!CanNegate(   p_ctx->info.height)) return 0;
-    p_ctx->lines = ((p_ctx->info.height < 0) ?
-                    -p_ctx->info.height :
-                     p_ctx->info.height);
+    if(turns & 1)
+    {
+        if(p_ctx->flags & BMPREAD_TOP_DOWN)
+            p_ctx->flip = !p_ctx->flip;
+        else
+            p_ctx->mirror = !p_ctx->mirror;
+    }
+}
 
-    if(!(p_ctx->flags & BMPREAD_ANY_SIZE))
+/* A sub-function to Validate() that settles which part of the image we're
+ * decoding: the region the caller put in the context, or the whole image if
+ * they left region_width 0.  The caller's region is in the output's
+ * orientation, so it's moved to where it is in the lines we decode: across
+ * the diagonal when transposing and to the other side when mirroring.  (Rows
+ * already count in output order.)  Returns 0 if the region doesn't fit
+ * inside the image or nonzero if it's ok.
+ */
+static int ValidateRegion(read_context * p_ctx)
+{
+    if(!p_ctx->region_width)
     {
-        /* Both of these values have just been checked against being negative,
-         * and thus it's safe to pass them on as uint32_t.
-         */
-        if(!IsPowerOf2(p_ctx->info.width)) return 0;
-        if(!IsPowerOf2(p_ctx->lines))      return 0;
+        p_ctx->x            = 0;
+        p_ctx->y            = 0;
+        p_ctx->region_width = p_ctx->info.width;
+        p_ctx->region_lines = p_ctx->lines;
+        return 1;
     }
 
-    switch(p_ctx->info.compression)
+    if(p_ctx->transpose)
     {
-        case COMPRESSION_NONE:
-            if(p_ctx->info.bits != 1 && p_ctx->info.bits != 4 &&
-               p_ctx->info.bits != 8 && p_ctx->info.bits != 24) return 0;
-            break;
+        int32_t x     = p_ctx->x;
+        int32_t width = p_ctx->region_width;
 
-        case COMPRESSION_BITFIELDS:
-            if(p_ctx->info.bits != 16 && p_ctx->info.bits != 32) return 0;
-            break;
+        p_ctx->x            = p_ctx->y;
+        p_ctx->y            = x;
+        p_ctx->region_width = p_ctx->region_lines;
+        p_ctx->region_lines = width;
+    }
 
-        default: /* No compression supported yet (TODO: handle RLE). */
-            return 0;
-    }
-
-    p_ctx->file_line_len = GetLineLength(p_ctx->info.width, p_ctx->info.bits);
-    if(p_ctx->file_line_len == 0) return 0;
+    if(p_ctx->x < 0 || p_ctx->region_width <= 0) return 0;
+    if(p_ctx->y < 0 || p_ctx->region_lines <= 0) return 0;
 
-    p_ctx->out_channels = ((p_ctx->flags & BMPREAD_ALPHA) ? 4 : 3);
-
-    /* This check happens outside the following if, where it would seem to
-     * belong, because we make the same computation again in the future.
-     */
-    if(!CanMultiply(p_ctx->info.width, p_ctx->out_channels)) return 0;
+    /* Neither subtraction can overflow, since both sides are positive. */
+    if(p_ctx->x > p_ctx->info.width - p_ctx->region_width) return 0;
+    if(p_ctx->y > p_ctx->lines      - p_ctx->region_lines) return 0;
 
-    if(p_ctx->flags & BMPREAD_BYTE_ALIGN)
-        p_ctx->out_line_len = (size_t)p_ctx->info.width * p_ctx->out_channels;
-    else
-    {
-        p_ctx->out_line_len = GetLineLength(p_ctx->info.width,
-                                            p_ctx->out_channels * 8);
-        if(p_ctx->out_line_len == 0) return 0;
-    }
+    if(p_ctx->mirror)
+        p_ctx->x = p_ctx->info.width - p_ctx->region_width - p_ctx->x;
 
-    if(!ValidateBitfields(p_ctx))      return 0;
-    if(!ValidateAndReadPalette(p_ctx)) return 0;
+    return 1;
+}
 
-    /* Set things up for decoding. */
-    if(!(p_ctx->file_data = (uint8_t *)malloc(p_ctx->file_line_len))) return 0;
+/* A sub-function to Validate() that works out the size of the output from the
+ * region and any BMPREAD_SCALE_* flags.  Blocks at the right and top (or
+ * bottom) edges that are cut short by the region still make an output pixel.
+ */
+static void ValidateScale(read_context * p_ctx)
+{
+    p_ctx->scale_shift = (p_ctx->flags & BMPREAD_SCALE_8) / BMPREAD_SCALE_2;
+    p_ctx->scale       = (int32_t)1 << p_ctx->scale_shift;
 
-    if(!CanMakeSizeT(p_ctx->lines))                           return 0;
-    if(!CanMultiply( p_ctx->lines, p_ctx->out_line_len))      return 0;
-    if(!(p_ctx->data_out = (uint8_t *)
-         malloc((size_t)p_ctx->lines * p_ctx->out_line_len))) return 0;
+    /* Written this way to avoid overflow when rounding up. */
+    p_ctx->out_width = (p_ctx->region_width - 1) / p_ctx->scale + 1;
+    p_ctx->out_lines = (p_ctx->region_lines - 1) / p_ctx->scale + 1;
 
-    return 1;
+    /* Averaging decodes every pixel; otherwise we just pick the first of each
+     * block.
+     */
+    p_ctx->x_step = ((p_ctx->flags & BMPREAD_SCALE_AVERAGE) ?
+                     1 : (size_t)p_ctx->scale);
 }
 
-/* Evenly distribute a value that spans a given number of bits into 8 bits.
+/* A sub-function to Validate() that works out which bytes of each scan line
+ * hold the columns we're decoding.  When that's every column, we read whole
+ * lines, padding and all, so that consecutive lines can be read without
+ * seeking.
  */
-static uint32_t Make8Bits(uint32_t value, uint32_t bitspan)
+static void ValidateSpan(read_context * p_ctx)
 {
-    uint32_t output = 0;
-
-    if(bitspan == 8)
-        return value;
-    if(bitspan > 8)
-        return value >> (bitspan - 8);
+    size_t start_bits;
+    size_t end_bits;
 
-    value <<= (8 - bitspan); /* Shift it up into the most significant bits. */
-    while(value)
+    if(p_ctx->region_width == p_ctx->info.width)
     {
-        /* Repeat the bit pattern down into the least significant bits.  This
-         * gives an even distribution when extrapolating from [0, 2^bitspan-1]
-         * into [0, 2^8-1], and avoids both floating point and awkward integer
-         * multiplication.  Unfortunately, because we don't enforce a whitelist
-         * of bit patterns we support and can hard-code for, it necessitates a
-         * loop.  I believe this is a fairly efficient way to express the idea,
-         * but it'd still be nice if the compiler could optimize this whole
-         * function heavily, since it's called in a tight decode loop.
-         */
-        output |= value;
-        value >>= bitspan;
+        p_ctx->span_offset = 0;
+        p_ctx->span_len    = p_ctx->file_line_len;
+        p_ctx->skip_pixels = 0;
+        return;
     }
 
-    return output;
-}
+    /* None of this can overflow: x + region_width is within the image's width,
+     * and GetLineLength() has already checked that the image's width in bits,
+     * rounded up to a whole number of bytes, fits in a size_t.
+     */
+    start_bits = (size_t)p_ctx->x * p_ctx->info.bits;
+    end_bits   = ((size_t)p_ctx->x + p_ctx->region_width) * p_ctx->info.bits;
 
-/* Reads four bytes out of a memory buffer and converts it to a uint32_t.
- */
-#define LoadLittleUint32(buf) (((uint32_t)(buf)[0]      ) + \
-                               ((uint32_t)(buf)[1] <<  8) + \
-                               ((uint32_t)(buf)[2] << 16) + \
-                               ((uint32_t)(buf)[3] << 24))
+    p_ctx->span_offset = start_bits / 8;
+    p_ctx->span_len    = (end_bits + 7) / 8 - p_ctx->span_offset;
+    p_ctx->skip_pixels = (unsigned int)((start_bits % 8) / p_ctx->info.bits);
+}
 
-/* Decodes 32-bit bitmap data by applying bitmasks.  The 16- and 32-bit
- * decoders could be made more efficient by whitelisting supported bit patterns
- * ahead of time and special-casing their decoding here, but this allows us to
- * support more bitmask patterns, and shouldn't be *too* inefficient in any
- * case.
- *
- * Takes a pointer to an output buffer scan line (p_out), a pointer to the end
- * of the *pixel data* of this scan line (p_out_end), a pointer to the source
- * scan line of file data (p_file), and our context.
+/* A sub-function to Validate() that works out the output pixel format from the
+ * flags: how big each component is, how many channels there are, and what
+ * order they go in.  For grayscale, all three colors go to the same place, and
+ * for alpha only, everything does; decoders store alpha after the colors, so
+ * the right value ends up there.
  */
-static void Decode32(uint8_t * p_out,
-                     const uint8_t * p_out_end,
-                     const uint8_t * p_file,
-                     const read_context * p_ctx)
+static void ValidateFormat(read_context * p_ctx)
 {
-    const bitfield * bf = p_ctx->bitfields;
+    size_t colors = 3; /* How many color channels. */
+    size_t first  = 0; /* Where the color channels start. */
 
-    while(p_out < p_out_end)
-    {
-        uint32_t value = LoadLittleUint32(p_file);
+    /* Wide components are all made with 16 bits, the most any bitfield can
+     * hold once it's been checked against the file's depth.
+     */
+    if(p_ctx->flags & BMPREAD_FLOAT)
+        p_ctx->out_depth = sizeof(float);
+    else if(p_ctx->flags & BMPREAD_UINT16)
+        p_ctx->out_depth = sizeof(uint16_t);
+    else
+        p_ctx->out_depth = 1;
 
-        *p_out++ = Make8Bits(ApplyBitfield(value, bf[0]), bf[0].span);
-        *p_out++ = Make8Bits(ApplyBitfield(value, bf[1]), bf[1].span);
-        *p_out++ = Make8Bits(ApplyBitfield(value, bf[2]), bf[2].span);
-        if(p_ctx->out_channels == 4)
-        {
-            if(bf[3].span)
-                *p_out++ = Make8Bits(ApplyBitfield(value, bf[3]), bf[3].span);
-            else
-                *p_out++ = BMPREAD_DEFAULT_ALPHA;
-        }
+    p_ctx->comp_bits     = ((p_ctx->out_depth == 1) ? 8 : 16);
+    p_ctx->byte_scale    = ((p_ctx->out_depth == 1) ? 1 : 257);
+    p_ctx->default_alpha = BMPREAD_DEFAULT_ALPHA * p_ctx->byte_scale;
+
+    /* Alpha is never converted, so alpha only output has nothing to do. */
+    p_ctx->linear = ((p_ctx->flags & BMPREAD_LINEAR) &&
+                     !(p_ctx->flags & BMPREAD_ALPHA_ONLY));
+    if(p_ctx->linear)
+        BuildLinearTable(p_ctx);
+    p_ctx->direct = (p_ctx->out_depth == 1 && !p_ctx->linear);
 
-        p_file += 4;
+    if(p_ctx->flags & BMPREAD_ALPHA_ONLY)
+    {
+        p_ctx->out_channels = 1;
+        p_ctx->out_alpha    = 1;
+        p_ctx->premultiply  = 0;
+        p_ctx->gray         = 0;
+        p_ctx->channel_pos[0] = p_ctx->channel_pos[1] = 0;
+        p_ctx->channel_pos[2] = p_ctx->channel_pos[3] = 0;
+        return;
     }
-}
 
-/* Decodes 24-bit bitmap data--basically just swaps the order of color
- * components.
- */
-static void Decode24(uint8_t * p_out,
-                     const uint8_t * p_out_end,
-                     const uint8_t * p_file,
-                     const read_context * p_ctx)
-{
-    while(p_out < p_out_end)
+    p_ctx->out_alpha = ((p_ctx->flags & BMPREAD_ALPHA) ? 1 : 0);
+    if(!p_ctx->out_alpha)
+        p_ctx->keyed = 0;
+    p_ctx->drop_alpha = (p_ctx->out_alpha &&
+                         (p_ctx->flags & BMPREAD_DROP_OPAQUE_ALPHA));
+    p_ctx->scan_alpha = p_ctx->drop_alpha;
+    p_ctx->premultiply = (p_ctx->out_alpha &&
+                          (p_ctx->flags & BMPREAD_PREMULTIPLY));
+    p_ctx->gray      = ((p_ctx->flags & BMPREAD_GRAY)  ? 1 : 0);
+    if(p_ctx->gray)
+        colors = 1;
+    p_ctx->out_channels = colors + p_ctx->out_alpha;
+
+    p_ctx->channel_pos[3] = colors;
+    if(p_ctx->out_alpha && (p_ctx->flags & BMPREAD_ALPHA_FIRST))
     {
-        *p_out++ = *(p_file + 2);
-        *p_out++ = *(p_file + 1);
-        *p_out++ = *(p_file    );
-        if(p_ctx->out_channels == 4)
-            *p_out++ = BMPREAD_DEFAULT_ALPHA;
+        p_ctx->channel_pos[3] = 0;
+        first = 1;
+    }
 
-        p_file += 3;
+    if(p_ctx->gray)
+    {
+        p_ctx->channel_pos[0] = p_ctx->channel_pos[1] = first;
+        p_ctx->channel_pos[2] = first;
+        return;
     }
-}
 
-/* Reads two bytes out of a memory buffer and converts it to a uint16_t.
- */
-#define LoadLittleUint16(buf) (((uint16_t)(buf)[0]     ) + \
-                               ((uint16_t)(buf)[1] << 8))
+    p_ctx->channel_pos[0] = first + ((p_ctx->flags & BMPREAD_BGR) ? 2 : 0);
+    p_ctx->channel_pos[1] = first + 1;
+    p_ctx->channel_pos[2] = first + ((p_ctx->flags & BMPREAD_BGR) ? 0 : 2);
+}
 
-/* Decodes 16-bit bitmap data by applying bitmasks.
+/* A sub-function to Validate() that allocates the statistics we gather,
+ * when asked to, in the output format ValidateFormat() just settled.  That's
+ * before ValidateIndexed() turns the output into indices, so that indexed
+ * images get statistics of their palette's colors.  Returns 0 if out of
+ * memory, or nonzero on success.
  */
-static void Decode16(uint8_t * p_out,
-                     const uint8_t * p_out_end,
-                     const uint8_t * p_file,
-                     const read_context * p_ctx)
+static int ValidateStats(read_context * p_ctx)
 {
-    const bitfield * bf = p_ctx->bitfields;
+    size_t len = sizeof(*p_ctx->stats);
+    int c;
 
-    while(p_out < p_out_end)
-    {
-        uint16_t value = LoadLittleUint16(p_file);
+    if(!(p_ctx->flags & BMPREAD_STATS)) return 1;
 
-        *p_out++ = Make8Bits(ApplyBitfield(value, bf[0]), bf[0].span);
-        *p_out++ = Make8Bits(ApplyBitfield(value, bf[1]), bf[1].span);
-        *p_out++ = Make8Bits(ApplyBitfield(value, bf[2]), bf[2].span);
-        if(p_ctx->out_channels == 4)
-        {
-            if(bf[3].span)
-                *p_out++ = Make8Bits(ApplyBitfield(value, bf[3]), bf[3].span);
-            else
-                *p_out++ = BMPREAD_DEFAULT_ALPHA;
-        }
+    /* Indices are counted after the statistics, then looked up. */
+    if(p_ctx->flags & BMPREAD_INDEXED)
+        len += 256 * sizeof(*p_ctx->index_counts);
 
-        p_file += 2;
+    if(!(p_ctx->stats = (bmpread_stats_t *)
+         AllocateBuffer(p_ctx, BUFFER_STATS, len, 1))) return 0;
+    if(p_ctx->flags & BMPREAD_INDEXED)
+        p_ctx->index_counts = (unsigned long *)(void *)(p_ctx->stats + 1);
+
+    p_ctx->stats->channels = (int)p_ctx->out_channels;
+    p_ctx->stats->alpha    = (p_ctx->out_alpha ?
+                              (int)p_ctx->channel_pos[3] : -1);
+    for(c = 0; c < p_ctx->stats->channels; c++)
+    {
+        p_ctx->stats->min[c] = DBL_MAX;
+        p_ctx->stats->max[c] = -DBL_MAX;
     }
+
+    return 1;
 }
 
-/* Decodes 8-bit bitmap data by looking colors up in the palette.
+/* A sub-function to Validate() that works out whether each line can be decoded
+ * in place: read into the end of its own output line and decoded from there,
+ * with no separate file_data buffer and no extra copy.  That works when the
+ * span fits in the output line and the decoder, going left to right, never
+ * stores a pixel over bytes it hasn't loaded yet.  It's only worth the bother
+ * without averaging, which needs to decode every line into a buffer anyway,
+ * and for interleaved output, where a line's pixels are all together.
+ * Transposed and resized output decode lines into a buffer of their own.
  */
-static void Decode8(uint8_t * p_out,
-                    const uint8_t * p_out_end,
-                    const uint8_t * p_file,
-                    const read_context * p_ctx)
+static void ValidateInPlace(read_context * p_ctx)
 {
-    while(p_out < p_out_end) {
-        *p_out++ = p_ctx->palette[*p_file].red;
-        *p_out++ = p_ctx->palette[*p_file].green;
-        *p_out++ = p_ctx->palette[*p_file].blue;
-        if(p_ctx->out_channels == 4)
-            *p_out++ = BMPREAD_DEFAULT_ALPHA;
+    size_t pixel_len = p_ctx->out_channels * p_ctx->out_depth;
+    size_t last;
+    size_t offset;
 
-        p_file++;
-    }
+    p_ctx->in_place = 0;
+
+    if(p_ctx->transpose || p_ctx->target_width)       return;
+    if(p_ctx->x_step != (size_t)p_ctx->scale)         return;
+    if(p_ctx->out_planes != 1)                        return;
+    if(p_ctx->span_len > p_ctx->out_line_len)         return;
+
+    /* Each output pixel must take at least as many bytes as it consumes in
+     * the file, so the input stays ahead of the output the whole way along.
+     */
+    if(p_ctx->x_step * p_ctx->info.bits > pixel_len * 8) return;
+
+    /* Given that, the input's lead only shrinks, so it's enough to check it
+     * hasn't been caught by the last pixel.  None of this can overflow: it
+     * stays within the image's width in bits and the output line length.
+     */
+    offset = p_ctx->out_line_len - p_ctx->span_len;
+    last   = (size_t)p_ctx->out_width - 1;
+    if(offset + (last * p_ctx->x_step + p_ctx->skip_pixels) *
+                p_ctx->info.bits / 8 < last * pixel_len) return;
+
+    p_ctx->in_place        = 1;
+    p_ctx->in_place_offset = offset;
 }
 
-/* Decodes 4-bit bitmap data by looking colors up in the palette.
+/* A sub-function to Validate() that works out whether the file's lines are
+ * already exactly what we'd output, byte for byte: 8-bit indices output as
+ * indices, 24-bit data output as BGR, or 32-bit data with 8-bit masks in the
+ * same order as the output's channels (BGRA for the usual A8R8G8B8 masks, ABGR
+ * for R8G8B8A8, and so on), with the same padding, unscaled and full width.
+ * Such lines are read straight into the output and not decoded at all.
  */
-static void Decode4(uint8_t * p_out,
-                    const uint8_t * p_out_end,
-                    const uint8_t * p_file,
-                    const read_context * p_ctx)
+static void ValidateRaw(read_context * p_ctx)
 {
-    while(p_out < p_out_end)
-    {
-        unsigned int lookup = (*p_file & 0xf0U) >> 4;
+    size_t i;
 
-        *p_out++ = p_ctx->palette[lookup].red;
-        *p_out++ = p_ctx->palette[lookup].green;
-        *p_out++ = p_ctx->palette[lookup].blue;
-        if(p_ctx->out_channels == 4)
-            *p_out++ = BMPREAD_DEFAULT_ALPHA;
+    p_ctx->raw = 0;
 
-        if(p_out < p_out_end)
-        {
-            lookup = *p_file++ & 0x0fU;
+    if(!p_ctx->in_place || p_ctx->in_place_offset != 0)    return;
+    if(p_ctx->scale != 1)                                  return;
+    if(p_ctx->span_len != p_ctx->file_line_len)            return;
+    if(!p_ctx->direct || p_ctx->premultiply)               return;
+    if(p_ctx->lut || p_ctx->keyed || p_ctx->mirror)        return;
+    if(p_ctx->info.bits != p_ctx->out_channels * 8)        return;
 
-            *p_out++ = p_ctx->palette[lookup].red;
-            *p_out++ = p_ctx->palette[lookup].green;
-            *p_out++ = p_ctx->palette[lookup].blue;
-            if(p_ctx->out_channels == 4)
-                *p_out++ = BMPREAD_DEFAULT_ALPHA;
-        }
+    if(p_ctx->flags & BMPREAD_INDEXED)
+    {
+        p_ctx->raw = 1;
+        return;
+    }
+    if(p_ctx->gray || p_ctx->out_channels < 3)             return;
+
+    for(i = 0; i < p_ctx->out_channels; i++)
+    {
+        /* 24-bit files are always BGR, which the masks don't say. */
+        uint32_t mask = ((p_ctx->info.bits == 24) ?
+                         UINT32_C(0xff) << (8 * (2 - i)) :
+                         p_ctx->info.masks[i]);
+
+        if(mask != UINT32_C(0xff) << (8 * p_ctx->channel_pos[i])) return;
     }
+
+    p_ctx->raw = 1;
 }
 
-/* Decodes 1-bit bitmap data by looking colors up in the two-color palette.
+/* Sets how far apart the planes are in the buffer we're decoding into, and
+ * points the decoders at the right place for each channel.  Decoders write
+ * interleaved pixels unless the output is planar, except when averaging, since
+ * they decode into the line buffer then; DecodeAveragedLine() splits the
+ * averages into planes itself.  plane_len * out_planes must fit in a size_t.
+ * Offsets are in bytes, so they take the size of each component into account.
  */
-static void Decode1(uint8_t * p_out,
-                    const uint8_t * p_out_end,
-                    const uint8_t * p_file,
-                    const read_context * p_ctx)
+static void SetPlaneLen(read_context * p_ctx, size_t plane_len)
 {
-    while(p_out < p_out_end)
-    {
-        unsigned int bit;
-        for(bit = 0; bit < 8 && p_out < p_out_end; bit++)
-        {
-            unsigned int lookup = (*p_file >> (7 - bit)) & 1;
+    int interleaved = (p_ctx->out_planes == 1 ||
+                       p_ctx->x_step != (size_t)p_ctx->scale);
+    size_t i;
 
-            *p_out++ = p_ctx->palette[lookup].red;
-            *p_out++ = p_ctx->palette[lookup].green;
-            *p_out++ = p_ctx->palette[lookup].blue;
-            if(p_ctx->out_channels == 4)
-                *p_out++ = BMPREAD_DEFAULT_ALPHA;
-        }
+    p_ctx->plane_len = ((p_ctx->out_planes == 1) ? 0 : plane_len);
 
-        p_file++;
-    }
+    for(i = 0; i < 4; i++)
+        p_ctx->channel_at[i] = (interleaved ?
+                                p_ctx->channel_pos[i] * p_ctx->out_depth :
+                                p_ctx->channel_pos[i] * plane_len);
+    p_ctx->pixel_step = (interleaved ?
+                         p_ctx->out_channels * p_ctx->out_depth :
+                         p_ctx->out_depth);
 }
 
-/* Selects an above decoder and runs it for each scan line of the file.
- * Returns 0 if there's an error or 1 if it's gravy.
+/* A sub-function to ValidateLayout() that works out the size of the output,
+ * which only depends on the headers and the flags, not the output format.
+ * Returns 0 on invalid region or flags that can't go together, or nonzero on
+ * success.
  */
-static int Decode(read_context * p_ctx)
+static int ValidateSize(read_context * p_ctx)
 {
-    void (* decoder)(uint8_t *, const uint8_t *, const uint8_t *,
-                     const read_context *);
+    ValidateOrientation(p_ctx);
+    if(!ValidateRegion(p_ctx)) return 0;
+    ValidateScale(p_ctx);
+
+    /* Transposing swaps the dimensions we decode for the output's. */
+    p_ctx->image_width = (p_ctx->transpose ? p_ctx->out_lines :
+                                             p_ctx->out_width);
+    p_ctx->image_lines = (p_ctx->transpose ? p_ctx->out_width :
+                                             p_ctx->out_lines);
+
+    /* Resizing resamples the lines we decode to the caller's size.  That
+     * needs lines to come out whole and in order, and colors to blend, which
+     * indices don't.
+     */
+    if(p_ctx->target_width)
+    {
+        if(p_ctx->transpose)               return 0;
+        if(p_ctx->flags & BMPREAD_INDEXED) return 0;
+        p_ctx->image_width = p_ctx->target_width;
+        p_ctx->image_lines = p_ctx->target_lines;
+    }
 
-    uint8_t * p_out;      /* Pointer to current scan line in output buffer. */
-    uint8_t * p_out_end;  /* End marker for output buffer. */
-    uint8_t * p_line_end; /* Pointer to end of current scan line in output. */
+    return 1;
+}
 
-    /* out_inc is an incrementor for p_out to advance it one scan line.  I'm
-     * not exactly sure what the correct type for it would be, perhaps ssize_t,
-     * but that's not C standard.  I went with ptrdiff_t because its value
-     * will be equivalent to the difference between two pointers, whether it
-     * was derived that way or not.
-     */
-    ptrdiff_t out_inc;
+/* Works out everything that depends on which region of the image we're
+ * decoding: the size of the output, the span of each scan line we read, and
+ * the output line length.  Validate() calls this once the output format is
+ * settled, and it can be called again to move on to another region no bigger
+ * than the first.  Returns 0 on invalid region or overflow or nonzero on
+ * success.
+ */
+static int ValidateLayout(read_context * p_ctx)
+{
+    size_t line_channels;
+    size_t pixel_len;
+    size_t plane_len;
 
-    /* Double check this won't overflow.  Who knows, man. */
-#if SIZE_MAX > PTRDIFF_MAX
-    if(p_ctx->out_line_len > PTRDIFF_MAX) return 0;
-#endif
-    out_inc = p_ctx->out_line_len;
+    if(!ValidateSize(p_ctx)) return 0;
 
-    if(!(p_ctx->info.height < 0) == !(p_ctx->flags & BMPREAD_TOP_DOWN))
+    /* Padding puts the image in the first columns and lines of an output
+     * with power of 2 dimensions.  Everything below that lays out the output
+     * goes by its padded size.
+     */
+    p_ctx->pad_width = p_ctx->image_width;
+    p_ctx->pad_lines = p_ctx->image_lines;
+    if(p_ctx->flags & BMPREAD_PAD_POW2)
     {
-        /* We're keeping scan lines in order.  These and subsequent operations
-         * have all been checked earlier.
-         */
-        p_out     = p_ctx->data_out;
-        p_out_end = p_ctx->data_out +
-                    ((size_t)p_ctx->lines * p_ctx->out_line_len);
+        if(!(p_ctx->pad_width = NextPowerOf2(p_ctx->image_width))) return 0;
+        if(!(p_ctx->pad_lines = NextPowerOf2(p_ctx->image_lines))) return 0;
     }
-    else /* We're reversing scan lines. */
+    else if(!(p_ctx->flags & BMPREAD_ANY_SIZE))
     {
-        /* TODO: I'm not 100% sure about the legality, purely C spec-wise, of
-         * this subtraction.
+        /* Both of these values have just been checked against being negative,
+         * and thus it's safe to pass them on as uint32_t.
          */
-        p_out_end = p_ctx->data_out - p_ctx->out_line_len;
-        p_out     = p_ctx->data_out +
-                    (((size_t)p_ctx->lines - 1) * p_ctx->out_line_len);
-
-        /* Always safe, given two's complement, since it was positive. */
-        out_inc = -out_inc;
+        if(!IsPowerOf2(p_ctx->image_width)) return 0;
+        if(!IsPowerOf2(p_ctx->image_lines)) return 0;
     }
 
-    p_line_end = p_out + (size_t)p_ctx->info.width * p_ctx->out_channels;
-
-    switch(p_ctx->info.bits)
+    /* Mipmaps halve the output until it's 1x1.  Indices don't average. */
+    p_ctx->levels = 1;
+    if(p_ctx->flags & BMPREAD_MIPMAPS)
     {
-        case 32: decoder = Decode32; break;
-        case 24: decoder = Decode24; break;
-        case 16: decoder = Decode16; break;
-        case 8:  decoder = Decode8;  break;
-        case 4:  decoder = Decode4;  break;
-        case 1:  decoder = Decode1;  break;
-        default: return 0;
+        int32_t size = ((p_ctx->pad_width > p_ctx->pad_lines) ?
+                        p_ctx->pad_width : p_ctx->pad_lines);
+
+        if(p_ctx->flags & BMPREAD_INDEXED) return 0;
+        while(size >>= 1)
+            p_ctx->levels++;
     }
 
-    if(!CanMakeLong(p_ctx->header.data_offset))               return 0;
-    if(fseek(p_ctx->fp, p_ctx->header.data_offset, SEEK_SET)) return 0;
+    ValidateSpan(p_ctx);
+
+    /* Planar output has lines of one channel each, in out_channels planes. */
+    p_ctx->out_planes = ((p_ctx->flags & BMPREAD_PLANAR) ?
+                         p_ctx->out_channels : 1);
+    line_channels = p_ctx->out_channels / p_ctx->out_planes;
+    pixel_len     = line_channels * p_ctx->out_depth; /* At most 16. */
+
+    /* This check happens outside the following if, where it would seem to
+     * belong, because we make the same computation again in the future.
+     * Both dimensions are checked, since transposing decodes lines as wide
+     * as the output is tall.
+     */
+    if(!CanMultiply(p_ctx->out_width,
+                    p_ctx->out_channels * p_ctx->out_depth)) return 0;
+    if(!CanMultiply(p_ctx->out_lines,
+                    p_ctx->out_channels * p_ctx->out_depth)) return 0;
+    if(!CanMultiply(p_ctx->pad_width,
+                    p_ctx->out_channels * p_ctx->out_depth)) return 0;
 
-    while(p_out != p_out_end &&
-          fread(p_ctx->file_data, 1, p_ctx->file_line_len, p_ctx->fp) ==
-          p_ctx->file_line_len)
+    if(p_ctx->flags & BMPREAD_BYTE_ALIGN)
+        p_ctx->out_line_len = (size_t)p_ctx->pad_width * pixel_len;
+    else
     {
-        decoder(p_out, p_line_end, p_ctx->file_data, p_ctx);
+        p_ctx->out_line_len = GetLineLength(p_ctx->pad_width, pixel_len * 8);
+        if(p_ctx->out_line_len == 0) return 0;
+    }
 
-        p_out      += out_inc;
-        p_line_end += out_inc;
+    /* Each plane holds the whole output.  Streams decode one row at a time,
+     * and change this to suit.
+     */
+    plane_len = 0;
+    if(p_ctx->out_planes != 1)
+    {
+        if(!CanMultiply(p_ctx->pad_lines, p_ctx->out_line_len))    return 0;
+        plane_len = (size_t)p_ctx->pad_lines * p_ctx->out_line_len;
+        if(!CanMultiply(plane_len, p_ctx->out_planes))             return 0;
     }
+    p_ctx->out_plane_len = plane_len;
+
+    /* When transposing or resizing, lines are decoded into a band first,
+     * each of them with its planes packed together.  DecodeTransposed() and
+     * DecodeResized() know where the output's planes are.
+     */
+    if(p_ctx->transpose || p_ctx->target_width)
+        plane_len = (size_t)p_ctx->out_width * p_ctx->out_depth;
+    SetPlaneLen(p_ctx, plane_len);
+
+    ValidateInPlace(p_ctx);
+    ValidateRaw(p_ctx);
 
-    return (p_out == p_out_end);
+    /* The span may have moved, so we no longer know where in it we are. */
+    p_ctx->next_line = -1;
+
+    return 1;
 }
 
-/* Frees resources allocated by various functions along the way.  Only frees
- * data_out if !leave_data_out (if the bitmap loads successfully, you want the
- * data to remain until THEY free it).
+/* How many lines DecodeTransposed() decodes at a time.  Each output line gets
+ * this many pixels written together, while the band's lines stay in cache.
+ * BMPREAD_SCRATCH_SIZE() makes room for them.
  */
-static void FreeContext(read_context * p_ctx, int leave_data_out)
+#define BAND_LINES BMPREAD_SCRATCH_BAND_LINES
+
+/* Works out how to resample src pixels in a row into dst pixels, into the
+ * given filter, allocating it as the given BUFFER_* buffer and the one after.
+ * Shrinking averages the input each output pixel covers, like a box filter;
+ * growing interpolates between the two input pixels nearest its center,
+ * bilinearly.  Both are symmetric, so the filter for a row counted from the
+ * other end is just this one backward.  Returns 0 on overflow or if out of
+ * memory, or nonzero on success.
+ */
+static int BuildFilter(read_context * p_ctx,
+                       resample_filter * p_filter,
+                       int which,
+                       int32_t src,
+                       int32_t dst)
 {
-    if(p_ctx->fp)
-        fclose(p_ctx->fp);
-    if(p_ctx->palette)
-        free(p_ctx->palette);
-    if(p_ctx->file_data)
-        free(p_ctx->file_data);
+    double  scale = (double)src / dst;
+    int32_t taps  = ((src > dst) ? src / dst + 2 : 2);
+    int32_t o;
+
+    /* No box covers more input pixels than that. */
+    if(taps > src)
+        taps = src;
+    p_filter->taps = taps;
+
+    if(!CanMakeSizeT(dst))                                       return 0;
+    if(!CanMultiply(dst, sizeof(int32_t)))                       return 0;
+    if(!CanMultiply(dst, taps))                                  return 0;
+    if(!CanMultiply((size_t)dst * taps, sizeof(float)))          return 0;
+
+    if(!(p_filter->first = (int32_t *)
+         AllocateBuffer(p_ctx, which + 1,
+                        (size_t)dst * sizeof(int32_t), 0)))      return 0;
+    if(!(p_filter->weights = (float *)
+         AllocateBuffer(p_ctx, which,
+                        (size_t)dst * taps * sizeof(float), 0))) return 0;
+
+    for(o = 0; o < dst; o++)
+    {
+        float * p_weights = p_filter->weights + (size_t)o * taps;
+        int32_t first;
+        int32_t t;
+        float   sum = 0;
 
-    if(!leave_data_out && p_ctx->data_out)
-        free(p_ctx->data_out);
+        for(t = 0; t < taps; t++)
+            p_weights[t] = 0;
+
+        if(src > dst)
+        {
+            double start = o * scale;
+            double end   = start + scale;
+
+            first = (int32_t)start;
+            for(t = 0; t < taps && first + t < src; t++)
+            {
+                double left  = ((first + t > start) ? first + t : start);
+                double right = ((first + t + 1 < end) ? first + t + 1 : end);
+
+                if(right > left)
+                    p_weights[t] = (float)(right - left);
+            }
+        }
+        else
+        {
+            double center = (o + 0.5) * scale - 0.5;
+
+            if(center < 0)       center = 0;
+            if(center > src - 1) center = src - 1;
+
+            first        = (int32_t)center;
+            p_weights[0] = (float)(1 - (center - first));
+            if(taps > 1)
+                p_weights[1] = (float)(center - first);
+        }
+
+        /* Keep all the taps inside the row.  Any that fell off its end had no
+         * weight.
+         */
+        if(first > src - taps)
+        {
+            int32_t shift = first - (src - taps);
+
+            for(t = taps - 1; t >= 0; t--)
+                p_weights[t] = ((t >= shift) ? p_weights[t - shift] : 0);
+            first -= shift;
+        }
+        p_filter->first[o] = first;
+
+        /* So flat color stays exactly flat. */
+        for(t = 0; t < taps; t++)
+            sum += p_weights[t];
+        for(t = 0; t < taps; t++)
+            p_weights[t] /= sum;
+    }
+
+    return 1;
 }
 
-int bmpread(const char * bmp_file, unsigned int flags, bmpread_t * p_bmp_out)
+/* A sub-function to Validate() that gets ready to resize the lines we decode
+ * to the caller's size: builds the filters, and allocates the ring of lines,
+ * already resized across, that each output line is summed from.  Returns 0
+ * on overflow or if out of memory, or nonzero on success.
+ */
+static int ValidateResize(read_context * p_ctx)
 {
-    int success = 0;
+    size_t ring_len;
+
+    if(!BuildFilter(p_ctx, &p_ctx->across, BUFFER_ACROSS,
+                    p_ctx->out_width, p_ctx->image_width))    return 0;
+    if(!BuildFilter(p_ctx, &p_ctx->down, BUFFER_DOWN,
+                    p_ctx->out_lines, p_ctx->image_lines))    return 0;
+
+    /* ValidateLayout() checked the first multiplication. */
+    ring_len = (size_t)p_ctx->image_width * p_ctx->out_channels;
+    if(!CanMultiply(ring_len, p_ctx->down.taps))              return 0;
+    ring_len *= p_ctx->down.taps;
+    if(!CanMultiply(ring_len, sizeof(float)))                 return 0;
+
+    if(!(p_ctx->ring = (float *)
+         AllocateBuffer(p_ctx, BUFFER_RING,
+                        ring_len * sizeof(float), 0)))        return 0;
+    return 1;
+}
 
-    read_context ctx;
-    memset(&ctx, 0, sizeof(ctx));
+/* CRC-32C's (Castagnoli's) polynomial, bit reversed. */
+#define CRC32C_POLY UINT32_C(0x82f63b78)
 
-    do
+/* Multiplies a vector of 32 bits by a 32x32 matrix of bits, over GF(2), where
+ * each entry of mat is the column for one bit of vec.  Shifting a CRC past
+ * zeros is linear, so matrices like these can skip it past any number of them
+ * at once.
+ */
+static uint32_t Gf2Times(const uint32_t * mat, uint32_t vec)
+{
+    uint32_t sum = 0;
+
+    for(; vec; vec >>= 1, mat++)
     {
-        if(!bmp_file)  break;
-        if(!p_bmp_out) break;
-        memset(p_bmp_out, 0, sizeof(*p_bmp_out));
+        if(vec & 1)
+            sum ^= *mat;
+    }
+    return sum;
+}
+
+/* Sets product, which mustn't be either of the others, to the matrix a times
+ * the matrix b: shifting past what each of them does.
+ */
+static void Gf2Multiply(uint32_t * product, const uint32_t * a,
+                        const uint32_t * b)
+{
+    int n;
+    for(n = 0; n < 32; n++)
+        product[n] = Gf2Times(a, b[n]);
+}
 
-        ctx.flags = flags;
+/* Shifts a CRC past the given number of lines' worth of zeros. */
+static uint32_t ShiftCrc(const read_context * p_ctx,
+                         uint32_t crc,
+                         size_t lines)
+{
+    const uint32_t * p_shift = p_ctx->crc_shifts;
 
-        if(!(ctx.fp = fopen(bmp_file, "rb"))) break;
-        if(!Validate(&ctx))                   break;
-        if(!Decode(&ctx))                     break;
+    for(; lines; lines >>= 1, p_shift += 32)
+    {
+        if(lines & 1)
+            crc = Gf2Times(p_shift, crc);
+    }
+    return crc;
+}
 
-        /* Finally, make sure we can stuff these into ints.  I feel like this
-         * is slightly justified by how it keeps the header definition dead
-         * simple (including, well, no #includes).  I suppose this could also
-         * be done way earlier and maybe save some disk reads, but I like
-         * keeping the check with the code it's checking.
-         */
-#if INT32_MAX > INT_MAX
-        if(ctx.info.width > INT_MAX) break;
-        if(ctx.lines      > INT_MAX) break;
-#endif
+/* A sub-function to Validate() that gets ready to hash the output.  Each line
+ * of each plane is hashed on its own, as soon as it's output, then shifted
+ * past the lines that come after it in the output and mixed in with the rest.
+ * That way, lines can be finished in any order.  This builds the tables for
+ * hashing, and the matrices for shifting past 1, 2, 4, and so on lines.
+ * Returns 0 if out of memory or alpha might be dropped after it's hashed, or
+ * nonzero on success.
+ */
+static int ValidateChecksum(read_context * p_ctx)
+{
+    /* ValidateLayout() checked these can't overflow. */
+    size_t lines  = (size_t)p_ctx->pad_lines * p_ctx->out_planes;
+    size_t shifts = 0;
+    uint32_t shift[2][32];
+    uint32_t square[32];
+    size_t bytes;
+    size_t i;
+    int n;
+
+    if(p_ctx->drop_alpha) return 0;
+
+    p_ctx->crc_line_len = (size_t)p_ctx->pad_width * p_ctx->out_channels /
+                          p_ctx->out_planes * p_ctx->out_depth;
+
+    /* One matrix for each bit of the most lines any CRC is shifted past. */
+    while(lines >> shifts)
+        shifts++;
+
+    if(!(p_ctx->crc_table = (uint32_t *)
+         AllocateBuffer(p_ctx, BUFFER_CRC,
+                        (1024 + shifts * 32) * sizeof(uint32_t), 0)))
+        return 0;
+    p_ctx->crc_shifts = p_ctx->crc_table + 1024;
+
+    for(i = 0; i < 256; i++)
+    {
+        uint32_t crc = (uint32_t)i;
+        for(n = 0; n < 8; n++)
+            crc = ((crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1);
+        p_ctx->crc_table[i] = crc;
+    }
+    for(i = 256; i < 1024; i++)
+        p_ctx->crc_table[i] = (p_ctx->crc_table[i - 256] >> 8) ^
+                              p_ctx->crc_table[p_ctx->crc_table[i - 256] &
+                                               0xff];
 
-        p_bmp_out->width  = ctx.info.width;
-        p_bmp_out->height = ctx.lines;
-        p_bmp_out->flags  = ctx.flags;
-        p_bmp_out->data   = ctx.data_out;
+    /* Start with shifting past one zero bit, and square it up to a byte.
+     * The first shift[] holds the shift so far, starting with none at all.
+     */
+    square[0] = CRC32C_POLY;
+    for(n = 1; n < 32; n++)
+        square[n] = UINT32_C(1) << (n - 1);
+    for(i = 0; i < 3; i++)
+    {
+        Gf2Multiply(shift[1], square, square);
+        memcpy(square, shift[1], sizeof(square));
+    }
+    for(n = 0; n < 32; n++)
+        shift[0][n] = UINT32_C(1) << n;
 
-        success = 1;
-    } while(0);
+    /* Then multiply together the squares for each bit of a line's length. */
+    for(bytes = p_ctx->crc_line_len; bytes; bytes >>= 1)
+    {
+        if(bytes & 1)
+        {
+            Gf2Multiply(shift[1], square, shift[0]);
+            memcpy(shift[0], shift[1], sizeof(shift[0]));
+        }
+        Gf2Multiply(shift[1], square, square);
+        memcpy(square, shift[1], sizeof(square));
+    }
 
-    FreeContext(&ctx, success);
+    /* And square that for each power of 2 lines. */
+    if(shifts)
+        memcpy(p_ctx->crc_shifts, shift[0], sizeof(shift[0]));
+    for(i = 1; i < shifts; i++)
+        Gf2Multiply(p_ctx->crc_shifts + i * 32,
+                    p_ctx->crc_shifts + (i - 1) * 32,
+                    p_ctx->crc_shifts + (i - 1) * 32);
 
-    return success;
+    p_ctx->checksum = 0;
+    return 1;
 }
 
-void bmpread_free(bmpread_t * p_bmp)
+/* Reads and validates the bitmap header metadata from the context's file
+ * object.  Assumes the file pointer is at the start of the file.  Returns 1 if
+ * ok or 0 if error or invalid file.
+ */
+static int ValidateHeaders(read_context * p_ctx)
 {
-    if(p_bmp)
-    {
-        if(p_bmp->data)
-            free(p_bmp->data);
+    if(!ReadHeader(&p_ctx->header, p_ctx->fp)) return 0;
+    if(!ReadInfo(  &p_ctx->info,   p_ctx->fp)) return 0;
 
-        memset(p_bmp, 0, sizeof(*p_bmp));
+    if(p_ctx->info.info_size > UINT32_MAX - BMP_HEADER_SIZE) return 0;
+    p_ctx->headers_size = BMP_HEADER_SIZE + p_ctx->info.info_size;
+
+    if(p_ctx->header.data_offset < p_ctx->headers_size) return 0;
+    p_ctx->after_headers = p_ctx->header.data_offset - p_ctx->headers_size;
+
+    if(p_ctx->info.width <= 0 || p_ctx->info.height == 0) return 0;
+
+    if(!CanMakeSizeT(p_ctx->info.width))  return 0;
+    if(!CanNegate(   p_ctx->info.height)) return 0;
+    p_ctx->lines = ((p_ctx->info.height < 0) ?
+                    -p_ctx->info.height :
+                     p_ctx->info.height);
+
+    switch(p_ctx->info.compression)
+    {
+        case COMPRESSION_NONE:
+            if(p_ctx->info.bits != 1 && p_ctx->info.bits != 4 &&
+               p_ctx->info.bits != 8 && p_ctx->info.bits != 24) return 0;
+            break;
+
+        case COMPRESSION_BITFIELDS:
+            if(p_ctx->info.bits != 16 && p_ctx->info.bits != 32) return 0;
+            break;
+
+        default: /* No compression supported yet (TODO: handle RLE). */
+            return 0;
+    }
+
+    p_ctx->file_line_len = GetLineLength(p_ctx->info.width, p_ctx->info.bits);
+    if(p_ctx->file_line_len == 0) return 0;
+
+    return 1;
+}
+
+/* Reads and validates the bitmap header metadata from the context's file
+ * object, then everything else up to the pixel data, and gets ready to decode
+ * it.  Assumes the file pointer is at the start of the file.  Returns 1 if ok
+ * or 0 if error or invalid file.
+ */
+static int Validate(read_context * p_ctx)
+{
+    if(!ValidateHeaders(p_ctx)) return 0;
+
+    ValidateFormat(p_ctx);
+
+    if(!ValidateStats(p_ctx))          return 0;
+    if(!ValidateBitfields(p_ctx))      return 0;
+    if(!ValidateAndReadPalette(p_ctx)) return 0;
+    if(!ValidateIndexed(p_ctx))        return 0;
+    if(!ValidateLayout(p_ctx))         return 0;
+
+    /* Set things up for decoding.  The output buffer is left to the caller,
+     * since how much of the image it needs to hold at once varies.
+     */
+    if(!p_ctx->in_place &&
+       !(p_ctx->file_data = (uint8_t *)
+         AllocateBuffer(p_ctx, BUFFER_FILE_DATA, p_ctx->span_len, 0)))
+        return 0;
+
+    if(p_ctx->transpose || p_ctx->target_width)
+    {
+        /* ValidateLayout() checked the first multiplication.  Resizing only
+         * needs a line at a time.
+         */
+        size_t band_line_len = (size_t)p_ctx->out_width *
+                               p_ctx->out_channels * p_ctx->out_depth;
+        size_t band_lines    = (p_ctx->transpose ? BAND_LINES : 1);
+
+        if(!CanMultiply(band_line_len, band_lines))           return 0;
+        if(!(p_ctx->band = (uint8_t *)
+             AllocateBuffer(p_ctx, BUFFER_BAND,
+                            band_line_len * band_lines, 0)))  return 0;
+    }
+
+    if(p_ctx->target_width && !ValidateResize(p_ctx)) return 0;
+    if((p_ctx->flags & BMPREAD_CHECKSUM) && !ValidateChecksum(p_ctx))
+        return 0;
+
+    if(p_ctx->x_step != (size_t)p_ctx->scale)
+    {
+        size_t pixel_len = p_ctx->out_channels * p_ctx->out_depth;
+        size_t sum_size  = ((p_ctx->flags & BMPREAD_FLOAT) ?
+                            sizeof(float) : sizeof(p_ctx->sums[0]));
+        size_t line_len;
+        size_t sums_len;
+
+        /* out_width is no bigger than region_width.  Float components are
+         * summed as floats, in the same buffer.
+         */
+        if(!CanMultiply(p_ctx->region_width, pixel_len))           return 0;
+        line_len = (size_t)p_ctx->region_width * pixel_len;
+        sums_len = (size_t)p_ctx->out_width    * p_ctx->out_channels;
+        if(!CanMultiply(sums_len, sum_size))                       return 0;
+        sums_len *= sum_size;
+
+        if(!(p_ctx->line = (uint8_t *)
+             AllocateBuffer(p_ctx, BUFFER_LINE, line_len, 0)))     return 0;
+        if(!(p_ctx->sums = (uint32_t *)
+             AllocateBuffer(p_ctx, BUFFER_SUMS, sums_len, 0)))     return 0;
+    }
+
+    return 1;
+}
+
+/* Evenly distribute a value that spans a given number of bits (bitspan) into
+ * the given number of bits (8 or 16).
+ */
+static uint32_t MakeBits(uint32_t value, uint32_t bitspan, uint32_t bits)
+{
+    uint32_t output = 0;
+
+    if(bitspan == bits)
+        return value;
+    if(bitspan > bits)
+        return value >> (bitspan - bits);
+
+    /* Shift it up into the most significant bits. */
+    value <<= (bits - bitspan);
+    while(value)
+    {
+        /* Repeat the bit pattern down into the least significant bits.  This
+         * gives an even distribution when extrapolating from [0, 2^bitspan-1]
+         * into [0, 2^bits-1], and avoids both floating point and awkward
+         * integer multiplication.  Unfortunately, because we don't enforce a
+         * whitelist of bit patterns we support and can hard-code for, it
+         * necessitates a loop.  I believe this is a fairly efficient way to
+         * express the idea, but it'd still be nice if the compiler could
+         * optimize this whole function heavily, since it's called in a tight
+         * decode loop.
+         */
+        output |= value;
+        value >>= bitspan;
+    }
+
+    return output;
+}
+
+/* Evenly distribute a value that spans a given number of bits into 8 bits.
+ */
+#define Make8Bits(value, bitspan) MakeBits(value, bitspan, 8)
+
+/* Reads four bytes out of a memory buffer and converts it to a uint32_t.
+ */
+#define LoadLittleUint32(buf) (((uint32_t)(buf)[0]      ) + \
+                               ((uint32_t)(buf)[1] <<  8) + \
+                               ((uint32_t)(buf)[2] << 16) + \
+                               ((uint32_t)(buf)[3] << 24))
+
+/* Makes the component of a 16- or 32-bit value under the given bitfield, with
+ * comp_bits bits.
+ */
+#define MakeComponent(value, bitfield, p_ctx) \
+        MakeBits(ApplyBitfield(value, bitfield), (bitfield).span, \
+                 (p_ctx)->comp_bits)
+
+/* Decodes 32-bit bitmap data by applying bitmasks.  The 16- and 32-bit
+ * decoders could be made more efficient by whitelisting supported bit patterns
+ * ahead of time and special-casing their decoding here, but this allows us to
+ * support more bitmask patterns, and shouldn't be *too* inefficient in any
+ * case.
+ *
+ * Takes a pointer to an output buffer scan line (p_out), a pointer to the end
+ * of the *pixel data* of this scan line (p_out_end), a pointer to the source
+ * scan line of file data (p_file), and our context.  The source may be in the
+ * output line itself (see ValidateInPlace()), so like all the decoders, this
+ * loads everything it needs for a pixel before storing any of it.  Each
+ * channel is stored wherever the output format puts it (see StorePixel()).
+ */
+static void Decode32(uint8_t * p_out,
+                     const uint8_t * p_out_end,
+                     const uint8_t * p_file,
+                     const read_context * p_ctx)
+{
+    const bitfield * bf       = p_ctx->bitfields;
+    int              alpha    = (p_ctx->out_alpha && bf[3].span);
+    size_t           out_step = p_ctx->pixel_step;
+    size_t           in_step  = 4 * p_ctx->x_step;
+
+    while(p_out < p_out_end)
+    {
+        uint32_t value = LoadLittleUint32(p_file);
+
+        StorePixel(p_out, p_ctx,
+                   MakeComponent(value, bf[0], p_ctx),
+                   MakeComponent(value, bf[1], p_ctx),
+                   MakeComponent(value, bf[2], p_ctx),
+                   (alpha ? MakeComponent(value, bf[3], p_ctx) :
+                            p_ctx->default_alpha));
+        p_out += out_step;
+
+        p_file += in_step;
+    }
+}
+
+/* Decodes 32-bit bitmap data whose color masks, and alpha mask if it has
+ * one, are each a whole byte, for plain output (see IsPlain()).  Each byte is
+ * copied straight to its place, 3 or 4 bytes a pixel.  Offsets are kept in
+ * locals, since stores through p_out could otherwise change them.
+ */
+static void Decode32Plain(uint8_t * p_out,
+                          const uint8_t * p_out_end,
+                          const uint8_t * p_file,
+                          const read_context * p_ctx)
+{
+    const bitfield * bf = p_ctx->bitfields;
+    size_t red   = bf[0].start / 8;
+    size_t green = bf[1].start / 8;
+    size_t blue  = bf[2].start / 8;
+    size_t alpha = bf[3].start / 8;
+    size_t r_at  = p_ctx->channel_at[0];
+    size_t g_at  = p_ctx->channel_at[1];
+    size_t b_at  = p_ctx->channel_at[2];
+    size_t a_at  = p_ctx->channel_at[3];
+
+    if(!p_ctx->out_alpha)
+    {
+        for(; p_out < p_out_end; p_out += 3, p_file += 4)
+        {
+            uint8_t r = p_file[red];
+            uint8_t g = p_file[green];
+            uint8_t b = p_file[blue];
+
+            p_out[r_at] = r;
+            p_out[g_at] = g;
+            p_out[b_at] = b;
+        }
+    }
+    else if(!bf[3].span)
+    {
+        for(; p_out < p_out_end; p_out += 4, p_file += 4)
+        {
+            uint8_t r = p_file[red];
+            uint8_t g = p_file[green];
+            uint8_t b = p_file[blue];
+
+            p_out[r_at] = r;
+            p_out[g_at] = g;
+            p_out[b_at] = b;
+            p_out[a_at] = BMPREAD_DEFAULT_ALPHA;
+        }
+    }
+    else
+    {
+        for(; p_out < p_out_end; p_out += 4, p_file += 4)
+        {
+            uint8_t r = p_file[red];
+            uint8_t g = p_file[green];
+            uint8_t b = p_file[blue];
+            uint8_t a = p_file[alpha];
+
+            p_out[r_at] = r;
+            p_out[g_at] = g;
+            p_out[b_at] = b;
+            p_out[a_at] = a;
+        }
+    }
+}
+
+/* Decodes 24-bit bitmap data--basically just swaps the order of color
+ * components.
+ */
+static void Decode24(uint8_t * p_out,
+                     const uint8_t * p_out_end,
+                     const uint8_t * p_file,
+                     const read_context * p_ctx)
+{
+    uint32_t scale    = p_ctx->byte_scale;
+    size_t   out_step = p_ctx->pixel_step;
+    size_t   in_step  = 3 * p_ctx->x_step;
+
+    while(p_out < p_out_end)
+    {
+        uint32_t blue  = *(p_file    ) * scale;
+        uint32_t green = *(p_file + 1) * scale;
+        uint32_t red   = *(p_file + 2) * scale;
+
+        StorePixel(p_out, p_ctx, red, green, blue, p_ctx->default_alpha);
+        p_out += out_step;
+
+        p_file += in_step;
+    }
+}
+
+/* Decodes 24-bit bitmap data for plain output (see IsPlain()), copying each
+ * byte straight to its place, 3 or 4 bytes a pixel, as Decode32Plain() does.
+ */
+static void Decode24Plain(uint8_t * p_out,
+                          const uint8_t * p_out_end,
+                          const uint8_t * p_file,
+                          const read_context * p_ctx)
+{
+    size_t r_at = p_ctx->channel_at[0];
+    size_t g_at = p_ctx->channel_at[1];
+    size_t b_at = p_ctx->channel_at[2];
+    size_t a_at = p_ctx->channel_at[3];
+
+    if(!p_ctx->out_alpha)
+    {
+        for(; p_out < p_out_end; p_out += 3, p_file += 3)
+        {
+            uint8_t b = p_file[0];
+            uint8_t g = p_file[1];
+            uint8_t r = p_file[2];
+
+            p_out[r_at] = r;
+            p_out[g_at] = g;
+            p_out[b_at] = b;
+        }
+        return;
+    }
+
+    for(; p_out < p_out_end; p_out += 4, p_file += 3)
+    {
+        uint8_t b = p_file[0];
+        uint8_t g = p_file[1];
+        uint8_t r = p_file[2];
+
+        p_out[r_at] = r;
+        p_out[g_at] = g;
+        p_out[b_at] = b;
+        p_out[a_at] = BMPREAD_DEFAULT_ALPHA;
+    }
+}
+
+/* Reads two bytes out of a memory buffer and converts it to a uint16_t.
+ */
+#define LoadLittleUint16(buf) (((uint16_t)(buf)[0]     ) + \
+                               ((uint16_t)(buf)[1] << 8))
+
+/* Decodes 16-bit bitmap data by applying bitmasks.
+ */
+static void Decode16(uint8_t * p_out,
+                     const uint8_t * p_out_end,
+                     const uint8_t * p_file,
+                     const read_context * p_ctx)
+{
+    const bitfield * bf       = p_ctx->bitfields;
+    int              alpha    = (p_ctx->out_alpha && bf[3].span);
+    size_t           out_step = p_ctx->pixel_step;
+    size_t           in_step  = 2 * p_ctx->x_step;
+
+    while(p_out < p_out_end)
+    {
+        uint32_t value = LoadLittleUint16(p_file);
+
+        StorePixel(p_out, p_ctx,
+                   MakeComponent(value, bf[0], p_ctx),
+                   MakeComponent(value, bf[1], p_ctx),
+                   MakeComponent(value, bf[2], p_ctx),
+                   (alpha ? MakeComponent(value, bf[3], p_ctx) :
+                            p_ctx->default_alpha));
+        p_out += out_step;
+
+        p_file += in_step;
+    }
+}
+
+/* Decodes 8-bit bitmap data by looking colors up in the palette.
+ */
+static void Decode8(uint8_t * p_out,
+                    const uint8_t * p_out_end,
+                    const uint8_t * p_file,
+                    const read_context * p_ctx)
+{
+    size_t out_step = p_ctx->pixel_step;
+    size_t in_step  = p_ctx->x_step;
+
+    while(p_out < p_out_end) {
+        StorePaletteColor(p_out, p_ctx, &p_ctx->palette[*p_file]);
+        p_out += out_step;
+
+        p_file += in_step;
+    }
+}
+
+/* Decodes 4-bit bitmap data by looking colors up in the palette.  We count
+ * pixels from the start of the span, since we may start (if reading a region)
+ * or step (if scaling) partway through a byte.  The high nibble of each byte
+ * is the first pixel.
+ */
+static void Decode4(uint8_t * p_out,
+                    const uint8_t * p_out_end,
+                    const uint8_t * p_file,
+                    const read_context * p_ctx)
+{
+    size_t pixel    = p_ctx->skip_pixels;
+    size_t out_step = p_ctx->pixel_step;
+    size_t in_step  = p_ctx->x_step;
+
+    while(p_out < p_out_end)
+    {
+        unsigned int lookup = (p_file[pixel >> 1] >> ((pixel & 1) ? 0 : 4)) &
+                              0x0fU;
+
+        StorePaletteColor(p_out, p_ctx, &p_ctx->palette[lookup]);
+        p_out += out_step;
+
+        pixel += in_step;
+    }
+}
+
+/* Decodes 1-bit bitmap data by looking colors up in the two-color palette.
+ * Pixels are counted the same way as in Decode4(), with the most significant
+ * bit of each byte as the first pixel.
+ */
+static void Decode1(uint8_t * p_out,
+                    const uint8_t * p_out_end,
+                    const uint8_t * p_file,
+                    const read_context * p_ctx)
+{
+    size_t pixel    = p_ctx->skip_pixels;
+    size_t out_step = p_ctx->pixel_step;
+    size_t in_step  = p_ctx->x_step;
+
+    while(p_out < p_out_end)
+    {
+        unsigned int lookup = (p_file[pixel >> 3] >> (7 - (pixel & 7))) & 1;
+
+        StorePaletteColor(p_out, p_ctx, &p_ctx->palette[lookup]);
+        p_out += out_step;
+
+        pixel += in_step;
+    }
+}
+
+/* Where each channel goes in a pixel of plain output, copied out of the
+ * context into locals by the palette decoders below, as Decode32Plain() does.
+ */
+typedef struct plain_layout
+{
+    size_t r_at;
+    size_t g_at;
+    size_t b_at;
+    size_t a_at;
+    int    alpha; /* Whether there's alpha to store. */
+
+} plain_layout;
+
+/* Sets up a plain_layout from the context. */
+static plain_layout GetPlainLayout(const read_context * p_ctx)
+{
+    plain_layout layout;
+
+    layout.r_at  = p_ctx->channel_at[0];
+    layout.g_at  = p_ctx->channel_at[1];
+    layout.b_at  = p_ctx->channel_at[2];
+    layout.a_at  = p_ctx->channel_at[3];
+    layout.alpha = p_ctx->out_alpha;
+    return layout;
+}
+
+/* Stores a palette entry as a pixel of plain output (see IsPlain()). */
+static void StorePlainColor(uint8_t * p_out,
+                            plain_layout layout,
+                            const bmp_color * color)
+{
+    uint8_t r = color->red;
+    uint8_t g = color->green;
+    uint8_t b = color->blue;
+    uint8_t a = color->alpha;
+
+    p_out[layout.r_at] = r;
+    p_out[layout.g_at] = g;
+    p_out[layout.b_at] = b;
+    if(layout.alpha)
+        p_out[layout.a_at] = a;
+}
+
+/* Decodes 8-bit bitmap data for plain output (see IsPlain()).
+ */
+static void Decode8Plain(uint8_t * p_out,
+                         const uint8_t * p_out_end,
+                         const uint8_t * p_file,
+                         const read_context * p_ctx)
+{
+    const bmp_color * palette = p_ctx->palette;
+    plain_layout      layout  = GetPlainLayout(p_ctx);
+
+    if(!layout.alpha)
+    {
+        for(; p_out < p_out_end; p_out += 3, p_file++)
+            StorePlainColor(p_out, layout, &palette[*p_file]);
+        return;
+    }
+
+    for(; p_out < p_out_end; p_out += 4, p_file++)
+        StorePlainColor(p_out, layout, &palette[*p_file]);
+}
+
+/* Decodes 4-bit bitmap data for plain output (see IsPlain()), counting pixels
+ * as Decode4() does.
+ */
+static void Decode4Plain(uint8_t * p_out,
+                         const uint8_t * p_out_end,
+                         const uint8_t * p_file,
+                         const read_context * p_ctx)
+{
+    const bmp_color * palette = p_ctx->palette;
+    plain_layout      layout  = GetPlainLayout(p_ctx);
+    size_t            step    = p_ctx->pixel_step;
+    size_t            pixel   = p_ctx->skip_pixels;
+
+    for(; p_out < p_out_end; p_out += step, pixel++)
+        StorePlainColor(p_out, layout,
+                        &palette[(p_file[pixel >> 1] >>
+                                  ((pixel & 1) ? 0 : 4)) & 0x0fU]);
+}
+
+/* Decodes 1-bit bitmap data for plain output (see IsPlain()), counting pixels
+ * as Decode1() does.
+ */
+static void Decode1Plain(uint8_t * p_out,
+                         const uint8_t * p_out_end,
+                         const uint8_t * p_file,
+                         const read_context * p_ctx)
+{
+    const bmp_color * palette = p_ctx->palette;
+    plain_layout      layout  = GetPlainLayout(p_ctx);
+    size_t            step    = p_ctx->pixel_step;
+    size_t            pixel   = p_ctx->skip_pixels;
+
+    for(; p_out < p_out_end; p_out += step, pixel++)
+        StorePlainColor(p_out, layout,
+                        &palette[(p_file[pixel >> 3] >> (7 - (pixel & 7))) &
+                                 1]);
+}
+
+/* Returns whether the output is plain: 8-bit colors, and alpha if any, in
+ * one interleaved plane, with no lookup tables, color key, grayscale, or
+ * premultiplying to apply, and every pixel of the file's lines decoded.
+ * That's the usual case, and decoders can then copy bytes straight out,
+ * without going through StorePixel() for each pixel.
+ */
+static int IsPlain(const read_context * p_ctx)
+{
+    return (p_ctx->direct && !p_ctx->gray && !p_ctx->lut && !p_ctx->keyed &&
+            !p_ctx->premultiply && p_ctx->out_planes == 1 &&
+            p_ctx->x_step == 1 &&
+            p_ctx->out_channels == 3 + (size_t)p_ctx->out_alpha);
+}
+
+/* Returns whether a 32-bit file's color masks, and alpha mask if it has one,
+ * each cover exactly one byte.
+ */
+static int HasByteMasks(const read_context * p_ctx)
+{
+    int i;
+
+    for(i = 0; i < 4; i++)
+    {
+        const bitfield * bf = &p_ctx->bitfields[i];
+
+        if(i == 3 && !bf->span) break;
+        if(bf->span != 8 || bf->start % 8) return 0;
+    }
+    return 1;
+}
+
+/* Returns the above decoder for the context's bit depth and output, or NULL
+ * if there isn't one.  The choice is made once for the whole image.  Plain
+ * output with no orientation change steps 3 or 4 bytes a pixel and never
+ * mirrors; the generic decoders' variable strides are only needed for
+ * scaling, planes or other output formats.
+ */
+static line_decoder GetDecoder(const read_context * p_ctx)
+{
+    int plain = IsPlain(p_ctx);
+
+    switch(p_ctx->info.bits)
+    {
+        case 32: return ((plain && HasByteMasks(p_ctx)) ?
+                         Decode32Plain : Decode32);
+        case 24: return (plain ? Decode24Plain : Decode24);
+        case 16: return Decode16;
+        case 8:  return (plain ? Decode8Plain : Decode8);
+        case 4:  return (plain ? Decode4Plain : Decode4);
+        case 1:  return (plain ? Decode1Plain : Decode1);
+        default: return NULL;
+    }
+}
+
+/* Returns nonzero if output lines are in the opposite order from how they're
+ * stored in the file, or 0 if they're in the same order.
+ */
+static int IsReversed(const read_context * p_ctx)
+{
+    return (!(p_ctx->info.height < 0) != !(p_ctx->flags & BMPREAD_TOP_DOWN)) !=
+           p_ctx->flip;
+}
+
+/* Returns the scan line (counting in file order from 0) that holds the given
+ * row of our region, counting rows in output order.
+ */
+static int32_t GetFileLine(const read_context * p_ctx, int32_t row)
+{
+    /* None of this can overflow, since the region is inside the image. */
+    if(IsReversed(p_ctx))
+        return p_ctx->lines - 1 - (p_ctx->y + row);
+    return p_ctx->y + row;
+}
+
+/* Reads the span of the given scan line (counting in file order from 0) that
+ * we're decoding into the given buffer, or when reading whole lines, that
+ * many consecutive lines all at once.  When we read whole
+ * lines, the file is only seeked if the line isn't the one right after the
+ * last one read, so reading lines in file order costs no more than reading the
+ * whole pixel array at once.  Returns 0 on error or nonzero on success.
+ */
+static int ReadLines(read_context * p_ctx,
+                     int32_t line,
+                     int32_t count,
+                     uint8_t * p_dest)
+{
+    size_t len;
+
+    if(line != p_ctx->next_line)
+    {
+        size_t offset;
+
+        /* line is never negative and has already been checked against lines,
+         * which has been checked against size_t.
+         */
+        if(!CanMultiply(line, p_ctx->file_line_len))       return 0;
+        offset = (size_t)line * p_ctx->file_line_len;
+        if(!CanAdd(offset, p_ctx->header.data_offset))     return 0;
+        offset += p_ctx->header.data_offset;
+        if(!CanAdd(offset, p_ctx->span_offset))            return 0;
+        offset += p_ctx->span_offset;
+
+        if(offset > (unsigned long)LONG_MAX)               return 0;
+        if(fseek(p_ctx->fp, (long)offset, SEEK_SET))       return 0;
+    }
+
+    /* count is never negative, and is no more than the lines in the output
+     * buffer we're reading into.
+     */
+    if(!CanMultiply(count, p_ctx->span_len)) return 0;
+    len = (size_t)count * p_ctx->span_len;
+
+    if(fread(p_dest, 1, len, p_ctx->fp) != len)
+    {
+        p_ctx->next_line = -1;
+        return 0;
+    }
+
+    /* Partial lines leave us in the middle of a line, not at the next one. */
+    p_ctx->next_line = ((p_ctx->span_len == p_ctx->file_line_len) ?
+                        line + count : -1);
+    return 1;
+}
+
+/* Reads a single scan line with ReadLines().
+ */
+#define ReadLine(p_ctx, line, p_dest) ReadLines(p_ctx, line, 1, p_dest)
+
+/* Decodes the given output row when scaling with BMPREAD_SCALE_AVERAGE, by
+ * decoding every line in the row's block at full size and averaging each
+ * block of pixels.  Returns 0 on error or nonzero on success.
+ */
+static int DecodeAveragedLine(read_context * p_ctx, uint8_t * p_out,
+                              int32_t row)
+{
+    size_t  channels = p_ctx->out_channels;
+    size_t  depth    = p_ctx->out_depth;
+    int     floats   = ((p_ctx->flags & BMPREAD_FLOAT) ? 1 : 0);
+    float * p_fsums  = (float *)(void *)p_ctx->sums; /* When floats. */
+    int32_t first    = row * p_ctx->scale; /* Can't overflow; see Decode(). */
+    int32_t rows     = p_ctx->region_lines - first;
+    int32_t i;
+    int32_t x;
+    size_t  c;
+
+    if(rows > p_ctx->scale)
+        rows = p_ctx->scale;
+
+    memset(p_ctx->sums, 0, (size_t)p_ctx->out_width * channels *
+                           (floats ? sizeof(float) : sizeof(p_ctx->sums[0])));
+
+    for(i = 0; i < rows; i++)
+    {
+        /* Go through the block's lines in file order, to avoid seeking. */
+        int32_t r = (IsReversed(p_ctx) ? rows - 1 - i : i);
+        const uint8_t * p_line = p_ctx->line;
+
+        if(!ReadLine(p_ctx, GetFileLine(p_ctx, first + r), p_ctx->file_data))
+            return 0;
+
+        p_ctx->decoder(p_ctx->line,
+                       p_ctx->line +
+                       (size_t)p_ctx->region_width * p_ctx->pixel_step,
+                       p_ctx->file_data,
+                       p_ctx);
+
+        for(x = 0; x < p_ctx->region_width; x++)
+        {
+            size_t at = (size_t)(x >> p_ctx->scale_shift) * channels;
+
+            for(c = 0; c < channels; c++, p_line += depth)
+            {
+                if(floats)
+                    p_fsums[at + c] += *(const float *)(const void *)p_line;
+                else if(depth == 1)
+                    p_ctx->sums[at + c] += *p_line;
+                else
+                    p_ctx->sums[at + c] +=
+                        *(const uint16_t *)(const void *)p_line;
+            }
+        }
+    }
+
+    for(x = 0; x < p_ctx->out_width; x++)
+    {
+        /* Blocks can be cut short at the edges of the region. */
+        int32_t  cols  = p_ctx->region_width - (x << p_ctx->scale_shift);
+        uint32_t count;
+
+        if(cols > p_ctx->scale)
+            cols = p_ctx->scale;
+        count = (uint32_t)rows * (uint32_t)cols;
+
+        for(c = 0; c < channels; c++)
+        {
+            size_t    at    = (size_t)x * channels + c;
+            uint8_t * p_avg = (p_ctx->plane_len ?
+                               p_out + c * p_ctx->plane_len + x * depth :
+                               p_out + at * depth);
+
+            if(floats)
+                *(float *)(void *)p_avg = p_fsums[at] / (float)count;
+            else
+            {
+                uint32_t average = (p_ctx->sums[at] + count / 2) / count;
+
+                if(depth == 1)
+                    *p_avg = (uint8_t)average;
+                else
+                    *(uint16_t *)(void *)p_avg = (uint16_t)average;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/* Reverses the order of the pixels in the output line at p_out, in each of
+ * its planes.
+ */
+static void MirrorLine(const read_context * p_ctx, uint8_t * p_out)
+{
+    size_t pixel_len = p_ctx->out_channels / p_ctx->out_planes *
+                       p_ctx->out_depth;
+    size_t p;
+
+    for(p = 0; p < p_ctx->out_planes; p++)
+    {
+        uint8_t * p_left  = p_out + p * p_ctx->plane_len;
+        uint8_t * p_right = p_left +
+                            (size_t)(p_ctx->out_width - 1) * pixel_len;
+
+        for(; p_left < p_right; p_left += pixel_len, p_right -= pixel_len)
+        {
+            size_t b;
+            for(b = 0; b < pixel_len; b++)
+            {
+                uint8_t t  = p_left[b];
+                p_left[b]  = p_right[b];
+                p_right[b] = t;
+            }
+        }
+    }
+}
+
+/* Reads the scan line(s) holding the given output row and decodes it into the
+ * output line at p_out.  Returns 0 on error or nonzero on success.
+ */
+static int DecodeLine(read_context * p_ctx, uint8_t * p_out, int32_t row)
+{
+    uint8_t * p_file = p_ctx->file_data;
+
+    if(p_ctx->sums)
+    {
+        if(!DecodeAveragedLine(p_ctx, p_out, row)) return 0;
+    }
+    else
+    {
+        if(p_ctx->in_place)
+            p_file = p_out + p_ctx->in_place_offset;
+
+        /* Without averaging, each output row is just the first line of its
+         * block.  This can't overflow, since that line is inside the region.
+         */
+        if(!ReadLine(p_ctx, GetFileLine(p_ctx, row * p_ctx->scale), p_file))
+            return 0;
+
+        if(!p_ctx->raw)
+            p_ctx->decoder(p_out,
+                           p_out +
+                           (size_t)p_ctx->out_width * p_ctx->pixel_step,
+                           p_file,
+                           p_ctx);
+    }
+
+    /* The line was just written, so it's still in cache. */
+    if(p_ctx->mirror)
+        MirrorLine(p_ctx, p_out);
+    return 1;
+}
+
+/* Copies a band of decoded lines into the output as columns, each line
+ * becoming one column, starting at the given column.  Works through the
+ * output a line at a time, writing each line's pixels from every line of the
+ * band together.
+ */
+static void TransposeBand(const read_context * p_ctx,
+                          const uint8_t * p_band,
+                          int32_t lines,
+                          int32_t column)
+{
+    size_t planes        = p_ctx->out_planes;
+    size_t pixel_len     = p_ctx->out_channels / planes * p_ctx->out_depth;
+    size_t band_line_len = (size_t)p_ctx->out_width * p_ctx->out_channels *
+                           p_ctx->out_depth;
+    size_t plane_len     = p_ctx->out_plane_len;
+    size_t p;
+    int32_t y;
+
+    for(p = 0; p < planes; p++)
+    {
+        /* Each band line's planes are out_width pixels apart. */
+        const uint8_t * p_plane = p_band + p * p_ctx->out_width * pixel_len;
+
+        for(y = 0; y < p_ctx->image_lines; y++)
+        {
+            uint8_t * p_out = p_ctx->data_out + p * plane_len +
+                              (size_t)y * p_ctx->out_line_len +
+                              (size_t)column * pixel_len;
+            const uint8_t * p_in = p_plane + (size_t)y * pixel_len;
+            int32_t i;
+
+            for(i = 0; i < lines; i++, p_in += band_line_len)
+            {
+                size_t b;
+                for(b = 0; b < pixel_len; b++)
+                    *p_out++ = p_in[b];
+            }
+        }
+    }
+}
+
+/* Loads a component of a decoded line, on the same scale it's stored on. */
+static float LoadComponent(const uint8_t * p, size_t depth)
+{
+    if(depth == 1)
+        return *p;
+    if(depth == sizeof(uint16_t))
+        return *(const uint16_t *)(const void *)p;
+    return *(const float *)(const void *)p;
+}
+
+/* Stores a resampled component, rounding it to the nearest integer unless
+ * it's a float.
+ */
+static void StoreResized(uint8_t * p, size_t depth, float value)
+{
+    float max = ((depth == 1) ? 255.0f : 65535.0f);
+
+    if(depth == sizeof(float))
+    {
+        *(float *)(void *)p = value;
+        return;
+    }
+
+    /* The weights sum to 1, but rounding can still stray out of range. */
+    if(value < 0)   value = 0;
+    if(value > max) value = max;
+
+    if(depth == 1)
+        *p = (uint8_t)(value + 0.5f);
+    else
+        *(uint16_t *)(void *)p = (uint16_t)(value + 0.5f);
+}
+
+/* Resizes the decoded line at p_line across, into interleaved floats at
+ * p_ring_line.
+ */
+static void ResizeLine(const read_context * p_ctx,
+                       const uint8_t * p_line,
+                       float * p_ring_line)
+{
+    size_t depth    = p_ctx->out_depth;
+    size_t channels = p_ctx->out_channels;
+    size_t c_step   = ((p_ctx->out_planes == 1) ? depth : p_ctx->plane_len);
+    size_t x_step   = channels / p_ctx->out_planes * depth;
+    int32_t taps    = p_ctx->across.taps;
+    size_t c;
+    int32_t x;
+
+    for(c = 0; c < channels; c++)
+    {
+        const float * p_weights = p_ctx->across.weights;
+
+        for(x = 0; x < p_ctx->image_width; x++, p_weights += taps)
+        {
+            const uint8_t * p_in = p_line + c * c_step +
+                                   (size_t)p_ctx->across.first[x] * x_step;
+            float sum = 0;
+            int32_t t;
+
+            for(t = 0; t < taps; t++, p_in += x_step)
+                sum += p_weights[t] * LoadComponent(p_in, depth);
+            p_ring_line[(size_t)x * channels + c] = sum;
+        }
+    }
+}
+
+/* Makes the given line of one mipmap level by averaging each 2x2 block of
+ * pixels in the two lines of the level before it that it stands for.  Levels
+ * only 1 pixel wide or tall average 2x1 or 1x2 blocks instead.  When a level
+ * is an odd number of pixels across, the next one leaves its last column
+ * out, and the same for lines.
+ */
+static void MipmapLine(const read_context * p_ctx,
+                       const mipmap_level * p_from,
+                       const mipmap_level * p_to,
+                       int32_t line)
+{
+    size_t depth     = p_ctx->out_depth;
+    size_t channels  = p_ctx->out_channels / p_ctx->out_planes;
+    size_t pixel_len = channels * depth;
+    size_t across    = ((p_from->width > 1) ? pixel_len : 0);
+    size_t down      = ((p_from->lines > 1) ? p_from->line_len : 0);
+    float  count     = (float)((across ? 2 : 1) * (down ? 2 : 1));
+    size_t p;
+
+    for(p = 0; p < p_ctx->out_planes; p++)
+    {
+        const uint8_t * p_in = p_ctx->data_out + p_from->offset +
+                               p * p_from->plane_len +
+                               (size_t)line * (down ? 2 : 1) *
+                               p_from->line_len;
+        uint8_t * p_out = p_ctx->data_out + p_to->offset +
+                          p * p_to->plane_len +
+                          (size_t)line * p_to->line_len;
+        int32_t x;
+
+        for(x = 0; x < p_to->width; x++, p_in += pixel_len + across)
+        {
+            size_t c;
+            for(c = 0; c < channels; c++, p_out += depth)
+            {
+                const uint8_t * p_comp = p_in + c * depth;
+                float sum = LoadComponent(p_comp, depth);
+
+                if(across)
+                    sum += LoadComponent(p_comp + across, depth);
+                if(down)
+                    sum += LoadComponent(p_comp + down, depth);
+                if(across && down)
+                    sum += LoadComponent(p_comp + down + across, depth);
+
+                StoreResized(p_out, depth, sum / count);
+            }
+        }
+    }
+}
+
+/* Called as each output line is finished, in whichever order they're made
+ * (reversed if they go from last to first), to make every line of the smaller
+ * mipmap levels that it finishes, while the lines they're made from are still
+ * in cache.
+ */
+static void FinishMipmapLine(read_context * p_ctx, int32_t line, int reversed)
+{
+    int n;
+
+    for(n = 1; n < p_ctx->levels; n++)
+    {
+        const mipmap_level * p_from = &p_ctx->mipmaps[n - 1];
+
+        /* A pair of lines is finished by whichever of them comes second. */
+        if(p_from->lines > 1)
+        {
+            if((line & 1) == reversed)    return;
+            line /= 2;
+            if(line >= p_ctx->mipmaps[n].lines) return;
+        }
+
+        MipmapLine(p_ctx, p_from, &p_ctx->mipmaps[n], line);
+    }
+}
+
+/* Runs a CRC-32C over len bytes, without the usual inversions before and
+ * after, four bytes at a time.
+ */
+static uint32_t UpdateCrc(const uint32_t * table,
+                          uint32_t crc,
+                          const uint8_t * p,
+                          size_t len)
+{
+    for(; len >= 4; len -= 4, p += 4)
+    {
+        crc ^= LoadLittleUint32(p);
+        crc = table[768 + (crc & 0xff)] ^ table[512 + ((crc >> 8) & 0xff)] ^
+              table[256 + ((crc >> 16) & 0xff)] ^ table[crc >> 24];
+    }
+    for(; len; len--, p++)
+        crc = table[(crc ^ *p) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+/* Hashes the given output line of each plane, shifted past the lines after
+ * it, into the checksum.
+ */
+static void HashLine(read_context * p_ctx, int32_t line)
+{
+    size_t p;
+
+    for(p = 0; p < p_ctx->out_planes; p++)
+    {
+        const uint8_t * p_line = p_ctx->data_out + p * p_ctx->out_plane_len +
+                                 (size_t)line * p_ctx->out_line_len;
+        size_t after = (p_ctx->out_planes - 1 - p) * (size_t)p_ctx->pad_lines +
+                       (size_t)(p_ctx->pad_lines - 1 - line);
+
+        p_ctx->checksum ^= ShiftCrc(p_ctx,
+                                    UpdateCrc(p_ctx->crc_table, 0, p_line,
+                                              p_ctx->crc_line_len),
+                                    after);
+    }
+}
+
+/* Counts a value of the given channel, on the scale of components depth bytes
+ * wide, count times into the statistics.
+ */
+static void CountValue(bmpread_stats_t * p_stats,
+                       int c,
+                       double value,
+                       unsigned long count,
+                       size_t depth)
+{
+    double bin = value;
+
+    if(depth == sizeof(uint16_t))
+        bin = value / 257;
+    else if(depth == sizeof(float))
+        bin = value * 255;
+    if(bin < 0)   bin = 0;
+    if(bin > 255) bin = 255;
+
+    p_stats->histogram[c][(unsigned int)(bin + 0.5)] += count;
+    if(value < p_stats->min[c]) p_stats->min[c] = value;
+    if(value > p_stats->max[c]) p_stats->max[c] = value;
+    p_stats->mean[c] += value * (double)count; /* Summed until the end. */
+}
+
+/* Counts the image's pixels in the given output line into the statistics.
+ * Bytes just go in the histogram, or in index_counts if they're indices; the
+ * rest comes from those at the end.
+ */
+static void CountLine(read_context * p_ctx, int32_t line)
+{
+    size_t depth  = p_ctx->out_depth;
+    size_t c_step = ((p_ctx->out_planes == 1) ? depth : p_ctx->out_plane_len);
+    size_t x_step = p_ctx->out_channels / p_ctx->out_planes * depth;
+    size_t c;
+
+    for(c = 0; c < p_ctx->out_channels; c++)
+    {
+        const uint8_t * p = p_ctx->data_out +
+                            (size_t)line * p_ctx->out_line_len + c * c_step;
+        int32_t x;
+
+        if(depth == 1)
+        {
+            unsigned long * p_bins = (p_ctx->index_counts ?
+                                      p_ctx->index_counts :
+                                      p_ctx->stats->histogram[c]);
+
+            for(x = 0; x < p_ctx->image_width; x++, p += x_step)
+                p_bins[*p]++;
+        }
+        else
+        {
+            for(x = 0; x < p_ctx->image_width; x++, p += x_step)
+                CountValue(p_ctx->stats, (int)c, LoadComponent(p, depth), 1,
+                           depth);
+        }
+    }
+}
+
+/* Works out everything CountLine() left for the end: looks up the indices
+ * counted in the palette, or finds the smallest, biggest, and total values in
+ * the histograms of bytes, then averages the totals.
+ */
+static void FinishStats(read_context * p_ctx)
+{
+    bmpread_stats_t * p_stats = p_ctx->stats;
+    size_t depth  = p_ctx->out_depth;
+    double pixels = (double)p_ctx->image_width * (double)p_ctx->image_lines;
+    double full;
+    int    c;
+    int    i;
+
+    if(p_ctx->index_counts)
+    {
+        /* The palette is in the format the output would have had. */
+        size_t entry_len;
+
+        depth = ((p_ctx->flags & BMPREAD_FLOAT)  ? sizeof(float) :
+                 (p_ctx->flags & BMPREAD_UINT16) ? sizeof(uint16_t) : 1);
+        entry_len = (size_t)p_stats->channels * depth;
+
+        for(i = 0; i < (int)p_ctx->palette_colors; i++)
+        {
+            if(!p_ctx->index_counts[i]) continue;
+            for(c = 0; c < p_stats->channels; c++)
+                CountValue(p_stats, c,
+                           LoadComponent(p_ctx->palette_out +
+                                         (size_t)i * entry_len +
+                                         (size_t)c * depth, depth),
+                           p_ctx->index_counts[i], depth);
+        }
+    }
+    else if(depth == 1)
+    {
+        for(c = 0; c < p_stats->channels; c++)
+        {
+            for(i = 0; i < 256; i++)
+            {
+                if(!p_stats->histogram[c][i]) continue;
+                if(i < p_stats->min[c]) p_stats->min[c] = i;
+                p_stats->max[c]   = i;
+                p_stats->mean[c] += (double)i *
+                                    (double)p_stats->histogram[c][i];
+            }
+        }
+    }
+
+    for(c = 0; c < p_stats->channels; c++)
+        p_stats->mean[c] /= pixels;
+
+    full = ((depth == 1) ? 255 : (depth == sizeof(uint16_t)) ? 65535 : 1);
+    p_stats->opaque = (p_stats->alpha < 0 ||
+                       p_stats->min[p_stats->alpha] >= full);
+}
+
+/* Returns whether each of count alpha components, step bytes apart starting
+ * at p, is full.
+ */
+static int IsOpaque(const uint8_t * p,
+                    int32_t count,
+                    size_t step,
+                    size_t depth)
+{
+    float full = ((depth == 1) ? 255.0f :
+                  (depth == sizeof(uint16_t)) ? 65535.0f : 1.0f);
+
+    for(; count > 0; count--, p += step)
+    {
+        if(LoadComponent(p, depth) < full) return 0;
+    }
+    return 1;
+}
+
+/* Fills the columns past the image's in the given output line, in each of its
+ * planes: with 0, or with BMPREAD_PAD_CLAMP, with copies of the line's last
+ * pixel.
+ */
+static void PadLine(const read_context * p_ctx, uint8_t * p_out)
+{
+    size_t pixel_len = p_ctx->out_channels / p_ctx->out_planes *
+                       p_ctx->out_depth;
+    size_t used      = (size_t)p_ctx->image_width * pixel_len;
+    size_t pad       = (size_t)(p_ctx->pad_width - p_ctx->image_width) *
+                       pixel_len;
+    size_t p;
+
+    if(!pad) return;
+
+    for(p = 0; p < p_ctx->out_planes; p++)
+    {
+        uint8_t * p_pad = p_out + p * p_ctx->out_plane_len + used;
+
+        if(p_ctx->flags & BMPREAD_PAD_CLAMP)
+        {
+            /* Copying forward a byte at a time repeats the last pixel. */
+            const uint8_t * p_from = p_pad - pixel_len;
+            size_t b;
+            for(b = 0; b < pad; b++)
+                p_pad[b] = p_from[b];
+        }
+        else
+            memset(p_pad, 0, pad);
+    }
+}
+
+/* Called as each line of the image is output, while it's still in cache, to
+ * check its alpha, count it, pad it, and hash it.
+ */
+static void FinishLine(read_context * p_ctx, int32_t line)
+{
+    /* Indices have no alpha: their palette's is checked at the end. */
+    if(p_ctx->scan_alpha && p_ctx->drop_alpha && !p_ctx->palette_out)
+    {
+        size_t depth  = p_ctx->out_depth;
+        size_t pos    = p_ctx->channel_pos[3];
+        size_t offset = ((p_ctx->out_planes == 1) ?
+                         pos * depth : pos * p_ctx->out_plane_len);
+
+        p_ctx->drop_alpha = IsOpaque(p_ctx->data_out +
+                                     (size_t)line * p_ctx->out_line_len +
+                                     offset,
+                                     p_ctx->image_width,
+                                     p_ctx->out_channels / p_ctx->out_planes *
+                                     depth, depth);
+    }
+    if(p_ctx->stats)
+        CountLine(p_ctx, line);
+    PadLine(p_ctx, p_ctx->data_out + (size_t)line * p_ctx->out_line_len);
+    if(p_ctx->crc_table)
+        HashLine(p_ctx, line);
+}
+
+/* Fills the lines past the image's, once the image is all output, in each
+ * plane: with 0, or with BMPREAD_PAD_CLAMP, with copies of the image's last
+ * line.  Then finishes the checksum and statistics, and makes the mipmaps of
+ * every line not made as it was output: just the padding's when late is 0, or
+ * all of them.
+ */
+static void FinishOutput(read_context * p_ctx, int late)
+{
+    int32_t i;
+    size_t  p;
+
+    for(i = p_ctx->image_lines; i < p_ctx->pad_lines; i++)
+    {
+        for(p = 0; p < p_ctx->out_planes; p++)
+        {
+            uint8_t * p_out = p_ctx->data_out + p * p_ctx->out_plane_len +
+                              (size_t)i * p_ctx->out_line_len;
+
+            if(p_ctx->flags & BMPREAD_PAD_CLAMP)
+                memcpy(p_out, p_out - p_ctx->out_line_len,
+                       p_ctx->out_line_len);
+            else
+                memset(p_out, 0, p_ctx->out_line_len);
+        }
+
+        if(p_ctx->crc_table)
+            HashLine(p_ctx, i);
+    }
+
+    /* The CRC of everything starts from all ones, shifted past every line,
+     * and is inverted at the end.
+     */
+    if(p_ctx->crc_table)
+        p_ctx->checksum = ~(p_ctx->checksum ^
+                            ShiftCrc(p_ctx, UINT32_C(0xffffffff),
+                                     (size_t)p_ctx->pad_lines *
+                                     p_ctx->out_planes));
+    if(p_ctx->stats)
+        FinishStats(p_ctx);
+
+    for(i = (late ? 0 : p_ctx->image_lines);
+        p_ctx->levels > 1 && i < p_ctx->pad_lines; i++)
+        FinishMipmapLine(p_ctx, i, 0);
+}
+
+/* Decodes the whole output when resizing.  Each line we decode is resized
+ * across as soon as it's decoded, into the ring, which holds just the last
+ * down.taps of them; each output line is then summed from the ring.  Lines
+ * are decoded in file order, and output lines made in the same order.  Their
+ * mipmaps are made as they're finished unless late is nonzero.  Returns 0 on
+ * error or nonzero on success.
+ */
+static int DecodeResized(read_context * p_ctx, int late)
+{
+    size_t  depth     = p_ctx->out_depth;
+    size_t  channels  = p_ctx->out_channels;
+    size_t  ring_line = (size_t)p_ctx->image_width * channels;
+    size_t  c_step    = ((p_ctx->out_planes == 1) ? depth :
+                         p_ctx->out_plane_len);
+    size_t  x_step    = channels / p_ctx->out_planes * depth;
+    int32_t taps      = p_ctx->down.taps;
+    int     reversed  = IsReversed(p_ctx);
+    int32_t next      = 0; /* Next line to decode, counting in file order. */
+    int32_t i;
+
+    for(i = 0; i < p_ctx->image_lines; i++)
+    {
+        int32_t row   = (reversed ? p_ctx->image_lines - 1 - i : i);
+        int32_t first = p_ctx->down.first[row];
+        const float * p_weights = p_ctx->down.weights + (size_t)row * taps;
+        uint8_t * p_out = p_ctx->data_out + (size_t)row * p_ctx->out_line_len;
+        int32_t x;
+        size_t c;
+
+        /* Counting in file order, the taps run the other way. */
+        if(reversed)
+            first = p_ctx->out_lines - taps - first;
+
+        /* Lines no output line needs are never decoded. */
+        if(next < first)
+            next = first;
+        for(; next < first + taps; next++)
+        {
+            if(!DecodeLine(p_ctx, p_ctx->band,
+                           (reversed ? p_ctx->out_lines - 1 - next : next)))
+                return 0;
+            ResizeLine(p_ctx, p_ctx->band,
+                       p_ctx->ring + (size_t)(next % taps) * ring_line);
+        }
+
+        for(x = 0; x < p_ctx->image_width; x++)
+        {
+            for(c = 0; c < channels; c++)
+            {
+                const float * p_ring = p_ctx->ring + (size_t)x * channels + c;
+                int32_t slot = first % taps;
+                float   sum  = 0;
+                int32_t t;
+
+                for(t = 0; t < taps; t++)
+                {
+                    sum += p_weights[reversed ? taps - 1 - t : t] *
+                           p_ring[(size_t)slot * ring_line];
+                    if(++slot == taps)
+                        slot = 0;
+                }
+
+                StoreResized(p_out + c * c_step + (size_t)x * x_step, depth,
+                             sum);
+            }
+        }
+
+        FinishLine(p_ctx, row);
+        if(!late)
+            FinishMipmapLine(p_ctx, row, reversed);
+    }
+
+    return 1;
+}
+
+/* Decodes the whole output when transposing, BAND_LINES lines at a time,
+ * going through the bands (and their lines) in file order.  Returns 0 on
+ * error or nonzero on success.
+ */
+static int DecodeTransposed(read_context * p_ctx)
+{
+    size_t  band_line_len = (size_t)p_ctx->out_width * p_ctx->out_channels *
+                            p_ctx->out_depth;
+    int32_t bands = (p_ctx->out_lines - 1) / BAND_LINES + 1;
+    int32_t b;
+
+    for(b = 0; b < bands; b++)
+    {
+        int32_t band  = (IsReversed(p_ctx) ? bands - 1 - b : b);
+        int32_t first = band * BAND_LINES;
+        int32_t lines = p_ctx->out_lines - first;
+        int32_t i;
+
+        if(lines > BAND_LINES)
+            lines = BAND_LINES;
+
+        for(i = 0; i < lines; i++)
+        {
+            int32_t row = (IsReversed(p_ctx) ? lines - 1 - i : i);
+
+            if(!DecodeLine(p_ctx, p_ctx->band + (size_t)row * band_line_len,
+                           first + row))
+                return 0;
+        }
+
+        TransposeBand(p_ctx, p_ctx->band, lines, first);
+    }
+
+    return 1;
+}
+
+/* Runs the context's decoder for each row we're decoding, filling the whole
+ * data_out buffer.  Returns 0 if there's an error or 1 if it's gravy.
+ */
+static int Decode(read_context * p_ctx)
+{
+    /* Mipmaps are made as each line is finished, unless padding lines, which
+     * can't be made until the image is, would have to come first.
+     */
+    int     reversed = IsReversed(p_ctx);
+    int     late     = (reversed && p_ctx->pad_lines != p_ctx->image_lines);
+    int32_t i;
+
+    if(p_ctx->target_width)
+    {
+        if(!DecodeResized(p_ctx, late)) return 0;
+    }
+
+    /* When the file already holds exactly our output, in the same order, it
+     * all comes in with a single read.  That and transposing finish every
+     * line at once, so padding and mipmaps come after.
+     */
+    else if(p_ctx->transpose || (p_ctx->raw && !reversed))
+    {
+        if(p_ctx->transpose)
+        {
+            if(!DecodeTransposed(p_ctx)) return 0;
+        }
+        else if(!ReadLines(p_ctx, GetFileLine(p_ctx, 0), p_ctx->out_lines,
+                           p_ctx->data_out))
+            return 0;
+
+        for(i = 0; i < p_ctx->image_lines; i++)
+            FinishLine(p_ctx, i);
+        late = 1;
+    }
+
+    else
+    {
+        for(i = 0; i < p_ctx->out_lines; i++)
+        {
+            /* Work through the rows in whichever order reads the file front
+             * to back, so we never have to seek between whole lines.
+             */
+            int32_t row = (reversed ? p_ctx->out_lines - 1 - i : i);
+
+            /* This has all been checked earlier. */
+            uint8_t * p_out = p_ctx->data_out +
+                              (size_t)row * p_ctx->out_line_len;
+
+            if(!DecodeLine(p_ctx, p_out, row)) return 0;
+            FinishLine(p_ctx, row);
+            if(!late)
+                FinishMipmapLine(p_ctx, row, reversed);
+        }
+    }
+
+    FinishOutput(p_ctx, late);
+    return 1;
+}
+
+/* Frees resources allocated by various functions along the way.  Only frees
+ * data_out and palette_out if !leave_data_out (if the bitmap loads
+ * successfully, you want the data to remain until THEY free it).  Buffers
+ * being reused from a bmpread_ctx_t are left alone, since they belong to it.
+ */
+static void FreeContext(read_context * p_ctx, int leave_data_out)
+{
+    if(p_ctx->fp)
+        fclose(p_ctx->fp);
+
+    if(p_ctx->buffers || p_ctx->scratch)
+        return;
+
+    if(p_ctx->palette)
+        Deallocate(&p_ctx->allocator, p_ctx->palette);
+    if(p_ctx->file_data)
+        Deallocate(&p_ctx->allocator, p_ctx->file_data);
+    if(p_ctx->line)
+        Deallocate(&p_ctx->allocator, p_ctx->line);
+    if(p_ctx->sums)
+        Deallocate(&p_ctx->allocator, p_ctx->sums);
+    if(p_ctx->band)
+        Deallocate(&p_ctx->allocator, p_ctx->band);
+    if(p_ctx->ring)
+        Deallocate(&p_ctx->allocator, p_ctx->ring);
+    if(p_ctx->across.first)
+        Deallocate(&p_ctx->allocator, p_ctx->across.first);
+    if(p_ctx->across.weights)
+        Deallocate(&p_ctx->allocator, p_ctx->across.weights);
+    if(p_ctx->down.first)
+        Deallocate(&p_ctx->allocator, p_ctx->down.first);
+    if(p_ctx->down.weights)
+        Deallocate(&p_ctx->allocator, p_ctx->down.weights);
+    if(p_ctx->crc_table)
+        Deallocate(&p_ctx->allocator, p_ctx->crc_table);
+
+    if(!leave_data_out && p_ctx->data_out)
+        Deallocate(&p_ctx->allocator, p_ctx->data_out);
+    if(!leave_data_out && p_ctx->palette_out)
+        Deallocate(&p_ctx->allocator, p_ctx->palette_out);
+    if(!leave_data_out && p_ctx->stats)
+        Deallocate(&p_ctx->allocator, p_ctx->stats);
+}
+
+/* Validates the context's open file, getting the context ready to decode.
+ * Assumes the file pointer is at the start of the file.  Returns 0 on error or
+ * invalid file or nonzero on success.
+ */
+static int Prepare(read_context * p_ctx, unsigned int flags)
+{
+    p_ctx->flags = flags;
+
+    if(!Validate(p_ctx))                                   return 0;
+    if(!(p_ctx->decoder = GetDecoder(p_ctx)))              return 0;
+
+    return 1;
+}
+
+/* Opens the given file and validates it, getting the context ready to decode.
+ * Returns 0 on error or invalid file or nonzero on success.  The context must
+ * be freed with FreeContext() either way.
+ */
+static int Open(read_context * p_ctx,
+                const char * bmp_file,
+                unsigned int flags)
+{
+    if(!(p_ctx->fp = fopen(bmp_file, "rb"))) return 0;
+
+    return Prepare(p_ctx, flags);
+}
+
+/* Opens the given file and reads just its headers, to find out how big its
+ * output would be with the given flags, into image_width and image_lines.
+ * Nothing is allocated.  Returns 0 on error or invalid file or nonzero on
+ * success.  The file is left open for FreeContext().
+ */
+static int Probe(read_context * p_ctx,
+                 const char * bmp_file,
+                 unsigned int flags)
+{
+    if(!(p_ctx->fp = fopen(bmp_file, "rb"))) return 0;
+
+    p_ctx->flags = flags;
+    if(!ValidateHeaders(p_ctx)) return 0;
+    return ValidateSize(p_ctx);
+}
+
+/* Fills out the caller's bmpread_t with the context's dimensions, flags, and
+ * output buffer.  Returns 0 if the dimensions can't be represented there or
+ * nonzero on success.
+ */
+static int FillResult(bmpread_t * p_bmp_out, const read_context * p_ctx)
+{
+    /* Make sure we can stuff these into ints.  I feel like this is slightly
+     * justified by how it keeps the header definition dead simple (including,
+     * well, just stddef.h, for size_t).  I suppose this could also be done way
+     * earlier and maybe save some disk reads, but I like keeping the check
+     * with the code it's checking.
+     */
+#if INT32_MAX > INT_MAX
+    if(p_ctx->pad_width > INT_MAX) return 0;
+    if(p_ctx->pad_lines > INT_MAX) return 0;
+#endif
+
+    p_bmp_out->width  = p_ctx->pad_width;
+    p_bmp_out->height = p_ctx->pad_lines;
+    p_bmp_out->flags  = p_ctx->flags;
+    p_bmp_out->data   = p_ctx->data_out;
+    p_bmp_out->colors = (int)p_ctx->palette_colors;
+    p_bmp_out->palette = p_ctx->palette_out;
+    p_bmp_out->levels = p_ctx->levels;
+    p_bmp_out->image_width  = p_ctx->image_width;
+    p_bmp_out->image_height = p_ctx->image_lines;
+    p_bmp_out->checksum     = p_ctx->checksum;
+    p_bmp_out->stats        = p_ctx->stats;
+
+    return 1;
+}
+
+/* Works out how many bytes are in each line of an image width pixels wide,
+ * and how many planes it has, in the format the flags ask for.  This is what
+ * ValidateFormat() and ValidateLayout() work out, from the flags alone, for
+ * anything but BMPREAD_INDEXED.  Returns 0 on overflow.
+ */
+static size_t GetFormatLineLength(unsigned int flags,
+                                  int32_t width,
+                                  size_t * p_planes)
+{
+    size_t channels = ((flags & BMPREAD_GRAY) ? 1 : 3) +
+                      ((flags & BMPREAD_ALPHA) ? 1 : 0);
+    size_t depth    = ((flags & BMPREAD_FLOAT)  ? sizeof(float) :
+                       (flags & BMPREAD_UINT16) ? sizeof(uint16_t) : 1);
+    size_t pixel_len;
+
+    if(flags & BMPREAD_ALPHA_ONLY)
+        channels = 1;
+
+    *p_planes = ((flags & BMPREAD_PLANAR) ? channels : 1);
+    pixel_len = channels / *p_planes * depth;
+
+    if(!CanMultiply(width, pixel_len)) return 0;
+    if(flags & BMPREAD_BYTE_ALIGN)
+        return (size_t)width * pixel_len;
+    return GetLineLength(width, pixel_len * 8);
+}
+
+/* Works out where each of the given number of mipmap levels of a width x
+ * lines image goes, in the format the flags ask for, one after another.
+ * Returns how many bytes they take all together, or 0 on overflow.
+ */
+static size_t GetLevels(unsigned int flags,
+                        int32_t width,
+                        int32_t lines,
+                        int levels,
+                        mipmap_level * p_levels)
+{
+    size_t total = 0;
+    int n;
+
+    for(n = 0; n < levels; n++)
+    {
+        mipmap_level * p_level = &p_levels[n];
+        size_t planes;
+
+        p_level->offset = total;
+        p_level->width  = ((width >> n) ? (width >> n) : 1);
+        p_level->lines  = ((lines >> n) ? (lines >> n) : 1);
+
+        if(!(p_level->line_len = GetFormatLineLength(flags, p_level->width,
+                                                     &planes)))   return 0;
+        if(!CanMakeSizeT(p_level->lines))                          return 0;
+        if(!CanMultiply(p_level->lines, p_level->line_len))        return 0;
+        p_level->plane_len = (size_t)p_level->lines * p_level->line_len;
+        if(!CanMultiply(p_level->plane_len, planes))               return 0;
+        if(!CanAdd(total, p_level->plane_len * planes))            return 0;
+        total += p_level->plane_len * planes;
+    }
+
+    return total;
+}
+
+/* Moves count pixels, step bytes apart starting at p_in, together at p_out,
+ * keeping the first len bytes of each.  p_out is never past p_in, so this
+ * can compact a line in place.
+ */
+static void CompactPixels(uint8_t * p_out,
+                          const uint8_t * p_in,
+                          size_t count,
+                          size_t len,
+                          size_t step)
+{
+    for(; count > 0; count--, p_out += len, p_in += step)
+        memmove(p_out, p_in, len);
+}
+
+/* Drops the alpha channel from the decoded output, once it's all turned out
+ * full: from each level of data_out, laid out again as though BMPREAD_ALPHA
+ * had never been asked for, or from the palette of indexed output, if its
+ * alpha is all full too.  Whatever comes first moves first, so everything
+ * can stay in place.  Then takes alpha out of the statistics and the flags
+ * the caller gets back.
+ */
+static void DropAlpha(read_context * p_ctx)
+{
+    unsigned int flags  = (p_ctx->flags &
+                           ~(BMPREAD_ALPHA | BMPREAD_ALPHA_FIRST));
+    size_t       depth  = ((flags & BMPREAD_FLOAT)  ? sizeof(float) :
+                           (flags & BMPREAD_UINT16) ? sizeof(uint16_t) : 1);
+    size_t       colors = ((flags & BMPREAD_GRAY) ? 1 : 3);
+    size_t       skip   = ((p_ctx->flags & BMPREAD_ALPHA_FIRST) ? 1 : 0);
+    mipmap_level from[MAX_LEVELS];
+    mipmap_level to[MAX_LEVELS];
+    int          n;
+
+    if(p_ctx->palette_out)
+    {
+        /* Indices have no alpha of their own: it's all in the palette. */
+        if(!IsOpaque(p_ctx->palette_out + (skip ? 0 : colors) * depth,
+                     (int32_t)p_ctx->palette_colors, (colors + 1) * depth,
+                     depth))
+            return;
+
+        CompactPixels(p_ctx->palette_out, p_ctx->palette_out + skip * depth,
+                      p_ctx->palette_colors, colors * depth,
+                      (colors + 1) * depth);
+    }
+    else
+    {
+        /* Read() already laid out the bigger of these without overflow. */
+        GetLevels(p_ctx->flags, p_ctx->pad_width, p_ctx->pad_lines,
+                  p_ctx->levels, from);
+        GetLevels(flags, p_ctx->pad_width, p_ctx->pad_lines, p_ctx->levels,
+                  to);
+
+        for(n = 0; n < p_ctx->levels; n++)
+        {
+            uint8_t * p_from = p_ctx->data_out + from[n].offset;
+            uint8_t * p_to   = p_ctx->data_out + to[n].offset;
+            size_t    i;
+
+            /* Planes are just left out; lines of pixels are squeezed. */
+            if(flags & BMPREAD_PLANAR)
+            {
+                for(i = 0; i < colors; i++)
+                    memmove(p_to + i * to[n].plane_len,
+                            p_from + (i + skip) * from[n].plane_len,
+                            to[n].plane_len);
+            }
+            else
+            {
+                for(i = 0; i < (size_t)to[n].lines; i++)
+                    CompactPixels(p_to + i * to[n].line_len,
+                                  p_from + i * from[n].line_len + skip * depth,
+                                  (size_t)to[n].width, colors * depth,
+                                  (colors + 1) * depth);
+            }
+        }
+    }
+
+    if(p_ctx->stats)
+    {
+        bmpread_stats_t * p_stats = p_ctx->stats;
+        int c;
+
+        for(c = p_stats->alpha; c < 3; c++)
+        {
+            memcpy(p_stats->histogram[c], p_stats->histogram[c + 1],
+                   sizeof(p_stats->histogram[c]));
+            p_stats->min[c]  = p_stats->min[c + 1];
+            p_stats->max[c]  = p_stats->max[c + 1];
+            p_stats->mean[c] = p_stats->mean[c + 1];
+        }
+        memset(p_stats->histogram[3], 0, sizeof(p_stats->histogram[3]));
+        p_stats->min[3] = p_stats->max[3] = p_stats->mean[3] = 0;
+        p_stats->channels--;
+        p_stats->alpha = -1;
+    }
+
+    p_ctx->flags = flags;
+}
+
+/* Allocates the context's data_out buffer, decodes into it, and hands it
+ * over to the caller's bmpread_t.  Returns 0 on error or nonzero on success.
+ */
+static int Read(read_context * p_ctx, bmpread_t * p_bmp_out)
+{
+    size_t len;
+
+    if(!CanMakeSizeT(p_ctx->pad_lines))                          return 0;
+    if(!CanMultiply( p_ctx->pad_lines, p_ctx->out_line_len))     return 0;
+    len = (size_t)p_ctx->pad_lines * p_ctx->out_line_len;
+    if(!CanMultiply(len, p_ctx->out_planes))                     return 0;
+    len *= p_ctx->out_planes;
+
+    /* The smaller levels follow the image. */
+    if(p_ctx->levels > 1 &&
+       !(len = GetLevels(p_ctx->flags, p_ctx->pad_width, p_ctx->pad_lines,
+                         p_ctx->levels, p_ctx->mipmaps)))
+        return 0;
+
+    if(!(p_ctx->data_out = (uint8_t *)
+         AllocateBuffer(p_ctx, BUFFER_DATA_OUT, len, 0)))
+        return 0;
+
+    if(!Decode(p_ctx))               return 0;
+    if(p_ctx->drop_alpha)
+        DropAlpha(p_ctx);
+    if(!FillResult(p_bmp_out, p_ctx)) return 0;
+
+    return 1;
+}
+
+int bmpread(const char * bmp_file, unsigned int flags, bmpread_t * p_bmp_out)
+{
+    int success = 0;
+
+    read_context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.allocator = global_allocator;
+
+    do
+    {
+        if(!bmp_file)  break;
+        if(!p_bmp_out) break;
+        memset(p_bmp_out, 0, sizeof(*p_bmp_out));
+
+        if(!Open(&ctx, bmp_file, flags)) break;
+
+        if(!Read(&ctx, p_bmp_out)) break;
+
+        success = 1;
+    } while(0);
+
+    FreeContext(&ctx, success);
+
+    return success;
+}
+
+int bmpread_region(const char * bmp_file,
+                   unsigned int flags,
+                   int x,
+                   int y,
+                   int width,
+                   int height,
+                   bmpread_t * p_bmp_out)
+{
+    int success = 0;
+
+    read_context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.allocator = global_allocator;
+
+    do
+    {
+        if(!bmp_file)  break;
+        if(!p_bmp_out) break;
+        memset(p_bmp_out, 0, sizeof(*p_bmp_out));
+
+        /* A width of 0 would mean the whole image to Validate(). */
+        if(width <= 0) break;
+
+#if INT_MAX > INT32_MAX
+        if(x > INT32_MAX || y > INT32_MAX)          break;
+        if(width > INT32_MAX || height > INT32_MAX) break;
+#endif
+
+        ctx.x            = x;
+        ctx.y            = y;
+        ctx.region_width = width;
+        ctx.region_lines = height;
+
+        if(!Open(&ctx, bmp_file, flags)) break;
+        if(!Read(&ctx, p_bmp_out))       break;
+
+        success = 1;
+    } while(0);
+
+    FreeContext(&ctx, success);
+
+    return success;
+}
+
+int bmpread_resized(const char * bmp_file,
+                    unsigned int flags,
+                    int width,
+                    int height,
+                    bmpread_t * p_bmp_out)
+{
+    int success = 0;
+
+    read_context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.allocator = global_allocator;
+
+    do
+    {
+        if(!bmp_file)  break;
+        if(!p_bmp_out) break;
+        memset(p_bmp_out, 0, sizeof(*p_bmp_out));
+
+        /* A width of 0 would mean not resizing to Validate(). */
+        if(width <= 0 || height <= 0) break;
+
+#if INT_MAX > INT32_MAX
+        if(width > INT32_MAX || height > INT32_MAX) break;
+#endif
+
+        ctx.target_width = width;
+        ctx.target_lines = height;
+
+        if(!Open(&ctx, bmp_file, flags)) break;
+        if(!Read(&ctx, p_bmp_out))       break;
+
+        success = 1;
+    } while(0);
+
+    FreeContext(&ctx, success);
+
+    return success;
+}
+
+int bmpread_level(const bmpread_t * p_bmp, int level, bmpread_t * p_level_out)
+{
+    mipmap_level levels[MAX_LEVELS];
+
+    if(!p_bmp)       return 0;
+    if(!p_level_out) return 0;
+    memset(p_level_out, 0, sizeof(*p_level_out));
+
+    if(!p_bmp->data)                           return 0;
+    if(level < 0 || level >= p_bmp->levels)    return 0;
+
+    if(!level)
+    {
+        *p_level_out = *p_bmp;
+        p_level_out->levels = 1;
+        return 1;
+    }
+
+    if(p_bmp->image_width <= 0 || p_bmp->image_height <= 0) return 0;
+
+    /* Loading laid the levels out the same way, so this can't overflow. */
+    if(!GetLevels(p_bmp->flags, p_bmp->width, p_bmp->height, level + 1,
+                  levels)) return 0;
+
+    p_level_out->width  = levels[level].width;
+    p_level_out->height = levels[level].lines;
+    p_level_out->flags  = p_bmp->flags;
+    p_level_out->data   = p_bmp->data + levels[level].offset;
+    p_level_out->levels = 1;
+
+    /* Padding shrinks along with the image, so the image fills every pixel
+     * made partly from it.
+     */
+    p_level_out->image_width  = ((p_bmp->image_width - 1) >> level) + 1;
+    p_level_out->image_height = ((p_bmp->image_height - 1) >> level) + 1;
+    if(p_level_out->image_width > p_level_out->width)
+        p_level_out->image_width = p_level_out->width;
+    if(p_level_out->image_height > p_level_out->height)
+        p_level_out->image_height = p_level_out->height;
+    return 1;
+}
+
+/* An image's place in the order bmpread_atlas() packs them in. */
+typedef struct atlas_entry
+{
+    int32_t width;
+    int32_t lines;
+    int     index; /* Which of the caller's files it is. */
+
+} atlas_entry;
+
+/* Sorts atlas entries tallest first, and widest first among the same height,
+ * which packs shelves tightly.
+ */
+static int CompareAtlasEntries(const void * p_a, const void * p_b)
+{
+    const atlas_entry * p_left  = (const atlas_entry *)p_a;
+    const atlas_entry * p_right = (const atlas_entry *)p_b;
+
+    if(p_left->lines != p_right->lines)
+        return ((p_left->lines > p_right->lines) ? -1 : 1);
+    if(p_left->width != p_right->width)
+        return ((p_left->width > p_right->width) ? -1 : 1);
+    return p_left->index - p_right->index;
+}
+
+/* Packs the atlas entries onto shelves width pixels wide, putting where each
+ * goes in the caller's rects.  Returns how tall the shelves end up, or 0 if
+ * an image is wider than the atlas or they're too tall altogether.
+ */
+static int32_t PackAtlas(atlas_entry * p_entries,
+                         int count,
+                         int32_t width,
+                         bmpread_rect_t * p_rects)
+{
+    int32_t x      = 0;
+    int32_t y      = 0;
+    int32_t shelf  = 0; /* How tall the current shelf is. */
+    int i;
+
+    qsort(p_entries, (size_t)count, sizeof(*p_entries), CompareAtlasEntries);
+
+    for(i = 0; i < count; i++)
+    {
+        const atlas_entry * p_entry = &p_entries[i];
+        bmpread_rect_t * p_rect = &p_rects[p_entry->index];
+
+        if(p_entry->width > width) return 0;
+
+        /* Start a new shelf when this one is full.  Its first image is the
+         * tallest it holds.
+         */
+        if(x > width - p_entry->width)
+        {
+            x = 0;
+            y += shelf;
+            shelf = 0;
+        }
+        if(!shelf)
+        {
+            if(p_entry->lines > INT32_MAX - y) return 0;
+            shelf = p_entry->lines;
+        }
+
+        p_rect->x      = x;
+        p_rect->y      = y;
+        p_rect->width  = p_entry->width;
+        p_rect->height = p_entry->lines;
+        x += p_entry->width;
+    }
+
+    return y + shelf;
+}
+
+/* Decodes one of bmpread_atlas()'s files into its place in the atlas, reusing
+ * the given buffers.  Returns 0 on error or invalid file or nonzero on
+ * success.
+ */
+static int DecodeIntoAtlas(const char * bmp_file,
+                           unsigned int flags,
+                           const bmpread_rect_t * p_rect,
+                           reusable_buffer * buffers,
+                           const bmpread_t * p_atlas,
+                           size_t line_len)
+{
+    int success = 0;
+
+    read_context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.buffers   = buffers;
+    ctx.allocator = global_allocator;
+
+    do
+    {
+        size_t pixel_len;
+
+        if(!Open(&ctx, bmp_file, flags)) break;
+
+        /* The file may have changed since it was probed. */
+        if(ctx.image_width != p_rect->width)  break;
+        if(ctx.image_lines != p_rect->height) break;
+
+        /* Reading into the output would land on the next image over, and
+         * whole lines at once would overrun this one's place.
+         */
+        if(ctx.in_place && !(ctx.file_data = (uint8_t *)
+           AllocateBuffer(&ctx, BUFFER_FILE_DATA, ctx.span_len, 0))) break;
+        ctx.in_place = 0;
+        ctx.raw      = 0;
+
+        /* Lines and planes are as long as the atlas's.  Transposing decodes
+         * into its band, with its own planes.
+         */
+        pixel_len = ctx.out_channels / ctx.out_planes * ctx.out_depth;
+        ctx.out_line_len  = line_len;
+        ctx.out_plane_len = ((ctx.out_planes == 1) ? 0 :
+                             line_len * (size_t)p_atlas->height);
+        if(!ctx.transpose)
+            SetPlaneLen(&ctx, ctx.out_plane_len);
+
+        /* The atlas was laid out to hold this image here. */
+        ctx.data_out = p_atlas->data + (size_t)p_rect->y * line_len +
+                       (size_t)p_rect->x * pixel_len;
+        success = Decode(&ctx);
+        ctx.data_out = NULL;
+    } while(0);
+
+    FreeContext(&ctx, 0);
+
+    return success;
+}
+
+int bmpread_atlas(const char * const * bmp_files,
+                  int count,
+                  unsigned int flags,
+                  int width,
+                  bmpread_t * p_atlas_out,
+                  bmpread_rect_t * p_rects_out)
+{
+    reusable_buffer buffers[BUFFER_COUNT];
+    atlas_entry * p_entries = NULL;
+    int success = 0;
+    int i;
+
+    memset(buffers, 0, sizeof(buffers));
+
+    do
+    {
+        int32_t lines;
+        size_t  line_len;
+        size_t  planes;
+        size_t  len;
+
+        if(!bmp_files)   break;
+        if(!p_atlas_out) break;
+        memset(p_atlas_out, 0, sizeof(*p_atlas_out));
+        if(!p_rects_out) break;
+        if(count <= 0)   break;
+        if(width <= 0)   break;
+
+#if INT_MAX > INT32_MAX
+        if(width > INT32_MAX) break;
+#endif
+
+        /* Each file has its own palette and can't be averaged with the
+         * others, images are already packed in with no padding, and lines
+         * are shared between them, as is whether they have alpha.
+         */
+        if(flags & (BMPREAD_INDEXED | BMPREAD_MIPMAPS | BMPREAD_PAD_POW2 |
+                    BMPREAD_CHECKSUM | BMPREAD_STATS |
+                    BMPREAD_DROP_OPAQUE_ALPHA))           break;
+        if(!(flags & BMPREAD_ANY_SIZE) && !IsPowerOf2(width)) break;
+
+        if(!CanMultiply((size_t)count, sizeof(*p_entries))) break;
+        if(!(p_entries = (atlas_entry *)
+             Allocate(&global_allocator, count * sizeof(*p_entries)))) break;
+
+        /* Only the headers are read to begin with, to plan the layout. */
+        for(i = 0; i < count; i++)
+        {
+            read_context ctx;
+            int probed;
+
+            memset(&ctx, 0, sizeof(ctx));
+            probed = (bmp_files[i] && Probe(&ctx, bmp_files[i],
+                                             flags | BMPREAD_ANY_SIZE));
+            FreeContext(&ctx, 0);
+            if(!probed) break;
+
+            p_entries[i].width = ctx.image_width;
+            p_entries[i].lines = ctx.image_lines;
+            p_entries[i].index = i;
+        }
+        if(i < count) break;
+
+        if(!(lines = PackAtlas(p_entries, count, width, p_rects_out))) break;
+        if(!(flags & BMPREAD_ANY_SIZE) && !(lines = NextPowerOf2(lines)))
+            break;
+
+#if INT32_MAX > INT_MAX
+        if(lines > INT_MAX) break;
+#endif
+
+        if(!(line_len = GetFormatLineLength(flags, width, &planes))) break;
+        if(!CanMakeSizeT(lines))                                       break;
+        if(!CanMultiply(lines, line_len))                             break;
+        len = (size_t)lines * line_len;
+        if(!CanMultiply(len, planes))                                 break;
+        len *= planes;
+
+        /* Anywhere no image lands is left zeroed. */
+        if(!(p_atlas_out->data = (unsigned char *)
+             Allocate(&global_allocator, len))) break;
+        memset(p_atlas_out->data, 0, len);
+        p_atlas_out->width  = width;
+        p_atlas_out->height = (int)lines;
+        p_atlas_out->flags  = flags;
+        p_atlas_out->levels = 1;
+        p_atlas_out->image_width  = width;
+        p_atlas_out->image_height = (int)lines;
+
+        /* Each image goes straight into its place. */
+        for(i = 0; i < count; i++)
+        {
+            if(!DecodeIntoAtlas(bmp_files[i], flags | BMPREAD_ANY_SIZE,
+                                &p_rects_out[i], buffers, p_atlas_out,
+                                line_len))
+                break;
+        }
+        if(i < count) break;
+
+        success = 1;
+    } while(0);
+
+    if(p_entries)
+        Deallocate(&global_allocator, p_entries);
+    for(i = 0; i < BUFFER_COUNT; i++)
+    {
+        if(buffers[i].data)
+            Deallocate(&global_allocator, buffers[i].data);
+    }
+
+    if(!success && p_atlas_out)
+    {
+        bmpread_free(p_atlas_out);
+        memset(p_atlas_out, 0, sizeof(*p_atlas_out));
+    }
+
+    return success;
+}
+
+void bmpread_set_allocator(const bmpread_allocator_t * p_alloc)
+{
+    if(p_alloc)
+        global_allocator = *p_alloc;
+    else
+    {
+        global_allocator.allocate   = DefaultAllocate;
+        global_allocator.deallocate = DefaultDeallocate;
+        global_allocator.user       = NULL;
+    }
+}
+
+int bmpread_into(void * fp,
+                 unsigned int flags,
+                 void * scratch,
+                 size_t scratch_size,
+                 unsigned char * data,
+                 size_t data_size,
+                 bmpread_t * p_bmp_out)
+{
+    int success = 0;
+
+    read_context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+
+    do
+    {
+        if(!fp)        break;
+        if(!scratch)   break;
+        if(!data)      break;
+        if(!p_bmp_out) break;
+        memset(p_bmp_out, 0, sizeof(*p_bmp_out));
+
+        ctx.scratch        = (uint8_t *)scratch;
+        ctx.scratch_left   = scratch_size;
+        ctx.caller_out     = data;
+        ctx.caller_out_len = data_size;
+
+        if(fseek((FILE *)fp, 0, SEEK_SET)) break;
+        ctx.fp = (FILE *)fp;
+
+        if(!Prepare(&ctx, flags))  break;
+        if(!Read(&ctx, p_bmp_out)) break;
+
+        success = 1;
+    } while(0);
+
+    /* The file is the caller's to close. */
+    ctx.fp = NULL;
+    FreeContext(&ctx, success);
+
+    return success;
+}
+
+bmpread_ctx_t * bmpread_ctx_new(void)
+{
+    return bmpread_ctx_new_with_allocator(NULL);
+}
+
+bmpread_ctx_t * bmpread_ctx_new_with_allocator(
+        const bmpread_allocator_t * p_alloc)
+{
+    bmpread_ctx_t * p_ctx;
+
+    if(!p_alloc)
+        p_alloc = &global_allocator;
+
+    if(!(p_ctx = (bmpread_ctx_t *)Allocate(p_alloc, sizeof(*p_ctx))))
+        return NULL;
+    memset(p_ctx, 0, sizeof(*p_ctx));
+    p_ctx->allocator = *p_alloc;
+
+    return p_ctx;
+}
+
+int bmpread_ctx_read(bmpread_ctx_t * p_ctx,
+                     const char * bmp_file,
+                     unsigned int flags,
+                     bmpread_t * p_bmp_out)
+{
+    int success = 0;
+
+    read_context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+
+    do
+    {
+        if(!p_ctx)   break;
+        if(!bmp_file)  break;
+        if(!p_bmp_out) break;
+        memset(p_bmp_out, 0, sizeof(*p_bmp_out));
+
+        ctx.buffers   = p_ctx->buffers;
+        ctx.allocator = p_ctx->allocator;
+        if(p_ctx->has_lut)
+            ctx.lut = (const uint8_t (*)[256])p_ctx->lut;
+        ctx.keyed     = p_ctx->has_color_key;
+        ctx.color_key = p_ctx->color_key;
+
+        if(!Open(&ctx, bmp_file, flags)) break;
+        if(!Read(&ctx, p_bmp_out))       break;
+
+        success = 1;
+    } while(0);
+
+    FreeContext(&ctx, success);
+
+    return success;
+}
+
+void bmpread_ctx_set_lut(bmpread_ctx_t * p_ctx,
+                         const unsigned char * red,
+                         const unsigned char * green,
+                         const unsigned char * blue)
+{
+    if(!p_ctx) return;
+
+    p_ctx->has_lut = (red != NULL);
+    if(!red) return;
+
+    if(!green)
+        green = red;
+    if(!blue)
+        blue = red;
+
+    memcpy(p_ctx->lut[0], red,   sizeof(p_ctx->lut[0]));
+    memcpy(p_ctx->lut[1], green, sizeof(p_ctx->lut[1]));
+    memcpy(p_ctx->lut[2], blue,  sizeof(p_ctx->lut[2]));
+}
+
+void bmpread_ctx_set_color_key(bmpread_ctx_t * p_ctx, long rgb)
+{
+    if(!p_ctx) return;
+
+    p_ctx->has_color_key = (rgb >= 0 && rgb <= 0xffffffL);
+    p_ctx->color_key     = (uint32_t)(p_ctx->has_color_key ? rgb : 0);
+}
+
+void bmpread_ctx_free(bmpread_ctx_t * p_ctx)
+{
+    if(p_ctx)
+    {
+        /* Copied out since it's about to be freed along with the context. */
+        bmpread_allocator_t allocator = p_ctx->allocator;
+        int i;
+
+        for(i = 0; i < BUFFER_COUNT; i++)
+        {
+            if(p_ctx->buffers[i].data)
+                Deallocate(&allocator, p_ctx->buffers[i].data);
+        }
+
+        Deallocate(&allocator, p_ctx);
+    }
+}
+
+void bmpread_free(bmpread_t * p_bmp)
+{
+    if(p_bmp)
+    {
+        if(p_bmp->data)
+            Deallocate(&global_allocator, p_bmp->data);
+        if(p_bmp->palette)
+            Deallocate(&global_allocator, p_bmp->palette);
+        if(p_bmp->stats)
+            Deallocate(&global_allocator, p_bmp->stats);
+
+        memset(p_bmp, 0, sizeof(*p_bmp));
+    }
+}
+
+/* The state behind a bmpread_stream_t.  The context's data_out buffer holds
+ * just the one line we hand back at a time.
+ */
+struct bmpread_stream_t
+{
+    read_context ctx;
+    int32_t      next_row; /* Next output row to decode. */
+};
+
+bmpread_stream_t * bmpread_open(const char * bmp_file,
+                                unsigned int flags,
+                                bmpread_t * p_bmp_out)
+{
+    bmpread_stream_t * p_stream;
+
+    if(!bmp_file)  return NULL;
+    if(!p_bmp_out) return NULL;
+    memset(p_bmp_out, 0, sizeof(*p_bmp_out));
+
+    if(!(p_stream = (bmpread_stream_t *)
+         Allocate(&global_allocator, sizeof(*p_stream)))) return NULL;
+    memset(p_stream, 0, sizeof(*p_stream));
+    p_stream->ctx.allocator = global_allocator;
+
+    do
+    {
+        read_context * p_ctx = &p_stream->ctx;
+
+        if(!Open(p_ctx, bmp_file, flags))                         break;
+
+        /* Rows that come out one at a time can't be columns of the file, or
+         * have mipmaps made from the whole image, or padding, a checksum,
+         * statistics, or dropped alpha after it.
+         */
+        if(p_ctx->transpose || p_ctx->levels > 1)                 break;
+        if(flags & (BMPREAD_PAD_POW2 | BMPREAD_CHECKSUM |
+                    BMPREAD_STATS | BMPREAD_DROP_OPAQUE_ALPHA))   break;
+
+        /* A row of planar output is a line of each plane, one after another.
+         */
+        if(!CanMultiply(p_ctx->out_line_len, p_ctx->out_planes))  break;
+        SetPlaneLen(p_ctx, p_ctx->out_line_len);
+        if(!(p_ctx->data_out = (uint8_t *)
+             AllocateBuffer(p_ctx, BUFFER_DATA_OUT,
+                            p_ctx->out_line_len * p_ctx->out_planes, 0)))
+            break;
+        if(!FillResult(p_bmp_out, p_ctx))                         break;
+
+        /* The caller never gets at the line buffer except through
+         * bmpread_next_row().
+         */
+        p_bmp_out->data = NULL;
+
+        return p_stream;
+    } while(0);
+
+    bmpread_close(p_stream);
+    memset(p_bmp_out, 0, sizeof(*p_bmp_out));
+    return NULL;
+}
+
+const unsigned char * bmpread_next_row(bmpread_stream_t * p_stream)
+{
+    read_context * p_ctx;
+
+    if(!p_stream) return NULL;
+    p_ctx = &p_stream->ctx;
+
+    if(p_stream->next_row >= p_ctx->out_lines) return NULL;
+
+    /* Rows come out in the order they'd have in bmpread()'s data, so we have
+     * to work backward through the file when that's reversed.
+     */
+    if(!DecodeLine(p_ctx, p_ctx->data_out, p_stream->next_row)) return NULL;
+
+    p_stream->next_row++;
+    return p_ctx->data_out;
+}
+
+void bmpread_close(bmpread_stream_t * p_stream)
+{
+    if(p_stream)
+    {
+        bmpread_allocator_t allocator = p_stream->ctx.allocator;
+
+        FreeContext(&p_stream->ctx, 0);
+        Deallocate(&allocator, p_stream);
+    }
+}
+
+/* A tile held in a bmpread_tiles_t's cache.
+ */
+typedef struct cached_tile
+{
+    int32_t         column;   /* Which tile this is, or -1 if none yet. */
+    int32_t         row;
+    int32_t         width;    /* Its size in pixels (smaller at the edges). */
+    int32_t         lines;
+    unsigned long   used;     /* When it was last handed out. */
+    uint8_t       * data;     /* Big enough for a full-size tile. */
+
+} cached_tile;
+
+/* The state behind a bmpread_tiles_t.  The context is validated once for the
+ * whole image, then pointed at each tile's region in turn.
+ */
+struct bmpread_tiles_t
+{
+    read_context   ctx;
+    int32_t        tile_size;   /* Width and height of a full-size tile. */
+    size_t         tile_len;    /* Bytes of data in a full-size tile. */
+    int32_t        columns;     /* How many tiles across. */
+    int32_t        rows;        /* How many tiles up (or down). */
+    cached_tile  * cache;       /* Least recently used tile gets replaced. */
+    size_t         cache_len;   /* Tiles allocated in the cache. */
+    size_t         cache_max;   /* Tiles that fit in the memory cap. */
+    unsigned long  clock;       /* Ticks each time a tile is handed out. */
+};
+
+bmpread_tiles_t * bmpread_tiles_open(const char * bmp_file,
+                                     unsigned int flags,
+                                     int tile_size,
+                                     unsigned long cache_size,
+                                     bmpread_t * p_bmp_out)
+{
+    bmpread_tiles_t * p_tiles;
+
+    if(!bmp_file)  return NULL;
+    if(!p_bmp_out) return NULL;
+    memset(p_bmp_out, 0, sizeof(*p_bmp_out));
+
+    if(tile_size <= 0) return NULL;
+#if INT_MAX > INT32_MAX
+    if(tile_size > INT32_MAX) return NULL;
+#endif
+
+    /* Tiles keep the power of 2 property of the image only if they're a power
+     * of 2 themselves.
+     */
+    if(!(flags & BMPREAD_ANY_SIZE) && !IsPowerOf2(tile_size)) return NULL;
+
+    if(!(p_tiles = (bmpread_tiles_t *)
+         Allocate(&global_allocator, sizeof(*p_tiles)))) return NULL;
+    memset(p_tiles, 0, sizeof(*p_tiles));
+    p_tiles->ctx.allocator = global_allocator;
+
+    do
+    {
+        read_context * p_ctx = &p_tiles->ctx;
+        size_t pixel_len;
+        size_t line_len;
+
+        if(!Open(p_ctx, bmp_file, flags)) break;
+        if(p_ctx->transpose)              break;
+        if(p_ctx->levels > 1)             break;
+        if(flags & (BMPREAD_PAD_POW2 | BMPREAD_CHECKSUM |
+                    BMPREAD_STATS |
+                    BMPREAD_DROP_OPAQUE_ALPHA)) break;
+        if(!FillResult(p_bmp_out, p_ctx)) break;
+        p_bmp_out->data = NULL;
+
+        /* Even if the whole image decodes in place, some tiles may not, so
+         * make sure there's a buffer big enough for any of their spans.
+         */
+        if(!p_ctx->file_data && !(p_ctx->file_data = (uint8_t *)
+           AllocateBuffer(p_ctx, BUFFER_FILE_DATA, p_ctx->span_len, 0))) break;
+
+        p_tiles->tile_size = tile_size;
+        p_tiles->columns   = (p_ctx->out_width - 1) / tile_size + 1;
+        p_tiles->rows      = (p_ctx->out_lines - 1) / tile_size + 1;
+
+        /* Same as the line length computation in ValidateLayout(). */
+        pixel_len = p_ctx->out_channels / p_ctx->out_planes * p_ctx->out_depth;
+        if(!CanMultiply(tile_size, pixel_len)) break;
+        if(flags & BMPREAD_BYTE_ALIGN)
+            line_len = (size_t)tile_size * pixel_len;
+        else if(!(line_len = GetLineLength(tile_size, pixel_len * 8)))
+            break;
+
+        if(!CanMultiply(line_len, tile_size)) break;
+        p_tiles->tile_len = line_len * tile_size;
+        if(!CanMultiply(p_tiles->tile_len, p_ctx->out_planes)) break;
+        p_tiles->tile_len *= p_ctx->out_planes;
+
+        /* Always keep at least the tile we've just handed out. */
+#if ULONG_MAX > SIZE_MAX
+        if(cache_size > SIZE_MAX)
+            cache_size = SIZE_MAX;
+#endif
+        p_tiles->cache_max = (size_t)cache_size / p_tiles->tile_len;
+        if(!p_tiles->cache_max)
+            p_tiles->cache_max = 1;
+
+        return p_tiles;
+    } while(0);
+
+    bmpread_tiles_close(p_tiles);
+    memset(p_bmp_out, 0, sizeof(*p_bmp_out));
+    return NULL;
+}
+
+/* Returns the cache entry to decode a new tile into: a fresh one while the
+ * cache is under its cap, or the least recently used one after that.  Returns
+ * NULL if out of memory.
+ */
+static cached_tile * GetFreeTile(bmpread_tiles_t * p_tiles)
+{
+    cached_tile * p_tile;
+    size_t i;
+
+    if(p_tiles->cache_len < p_tiles->cache_max)
+    {
+        const bmpread_allocator_t * p_alloc = &p_tiles->ctx.allocator;
+        cached_tile * cache;
+        uint8_t * data;
+
+        /* Grow the cache array one entry at a time.  It only ever holds a
+         * handful of entries, and this way we never need realloc().
+         */
+        if(!CanMultiply(p_tiles->cache_len + 1, sizeof(*cache))) return NULL;
+        if(!(cache = (cached_tile *)
+             Allocate(p_alloc, (p_tiles->cache_len + 1) * sizeof(*cache))))
+            return NULL;
+
+        if(!(data = (uint8_t *)Allocate(p_alloc, p_tiles->tile_len)))
+        {
+            Deallocate(p_alloc, cache);
+            return NULL;
+        }
+
+        if(p_tiles->cache)
+        {
+            memcpy(cache, p_tiles->cache, p_tiles->cache_len * sizeof(*cache));
+            Deallocate(p_alloc, p_tiles->cache);
+        }
+        p_tiles->cache = cache;
+
+        p_tile = &p_tiles->cache[p_tiles->cache_len++];
+        memset(p_tile, 0, sizeof(*p_tile));
+        p_tile->column = p_tile->row = -1;
+        p_tile->data   = data;
+        return p_tile;
+    }
+
+    p_tile = &p_tiles->cache[0];
+    for(i = 1; i < p_tiles->cache_len; i++)
+    {
+        if(p_tiles->cache[i].used < p_tile->used)
+            p_tile = &p_tiles->cache[i];
+    }
+    return p_tile;
+}
+
+/* Decodes the given tile into the given cache entry.  Returns 0 on error or
+ * nonzero on success.
+ */
+static int DecodeTile(bmpread_tiles_t * p_tiles,
+                      cached_tile * p_tile,
+                      int32_t column,
+                      int32_t row)
+{
+    read_context * p_ctx = &p_tiles->ctx;
+    int32_t left;
+    int success;
+
+    /* Convert the tile's position in the output into a region of the whole
+     * image.  None of this overflows: the tile starts inside the output, and
+     * scaling its start back up lands inside the image.
+     */
+    p_ctx->x = column * p_tiles->tile_size * p_ctx->scale;
+    p_ctx->y = row    * p_tiles->tile_size * p_ctx->scale;
+
+    left = (p_ctx->info.width - p_ctx->x) / p_ctx->scale;
+    p_ctx->region_width = ((left >= p_tiles->tile_size) ?
+                           p_tiles->tile_size * p_ctx->scale :
+                           p_ctx->info.width - p_ctx->x);
+
+    left = (p_ctx->lines - p_ctx->y) / p_ctx->scale;
+    p_ctx->region_lines = ((left >= p_tiles->tile_size) ?
+                           p_tiles->tile_size * p_ctx->scale :
+                           p_ctx->lines - p_ctx->y);
+
+    p_tile->column = -1;
+    if(!ValidateLayout(p_ctx)) return 0;
+
+    /* Lend Decode() the tile's buffer. */
+    p_ctx->data_out = p_tile->data;
+    success = Decode(p_ctx);
+    p_ctx->data_out = NULL;
+    if(!success) return 0;
+
+    p_tile->column = column;
+    p_tile->row    = row;
+    p_tile->width  = p_ctx->out_width;
+    p_tile->lines  = p_ctx->out_lines;
+    return 1;
+}
+
+int bmpread_tile(bmpread_tiles_t * p_tiles,
+                 int column,
+                 int row,
+                 bmpread_t * p_tile_out)
+{
+    cached_tile * p_tile = NULL;
+    size_t i;
+
+    if(!p_tiles)    return 0;
+    if(!p_tile_out) return 0;
+    memset(p_tile_out, 0, sizeof(*p_tile_out));
+
+    if(column < 0 || column >= p_tiles->columns) return 0;
+    if(row    < 0 || row    >= p_tiles->rows)    return 0;
+
+    for(i = 0; i < p_tiles->cache_len; i++)
+    {
+        if(p_tiles->cache[i].column == column && p_tiles->cache[i].row == row)
+        {
+            p_tile = &p_tiles->cache[i];
+            break;
+        }
+    }
+
+    if(!p_tile)
+    {
+        if(!(p_tile = GetFreeTile(p_tiles)))           return 0;
+        if(!DecodeTile(p_tiles, p_tile, column, row)) return 0;
+    }
+
+    p_tile->used = ++p_tiles->clock;
+
+    p_tile_out->width  = p_tile->width;
+    p_tile_out->height = p_tile->lines;
+    p_tile_out->flags  = p_tiles->ctx.flags;
+    p_tile_out->data   = p_tile->data;
+    p_tile_out->colors  = (int)p_tiles->ctx.palette_colors;
+    p_tile_out->palette = p_tiles->ctx.palette_out;
+    p_tile_out->levels  = 1;
+    p_tile_out->image_width  = p_tile->width;
+    p_tile_out->image_height = p_tile->lines;
+    return 1;
+}
+
+void bmpread_tiles_close(bmpread_tiles_t * p_tiles)
+{
+    if(p_tiles)
+    {
+        bmpread_allocator_t allocator = p_tiles->ctx.allocator;
+        size_t i;
+
+        for(i = 0; i < p_tiles->cache_len; i++)
+            Deallocate(&allocator, p_tiles->cache[i].data);
+        if(p_tiles->cache)
+            Deallocate(&allocator, p_tiles->cache);
+
+        FreeContext(&p_tiles->ctx, 0);
+        Deallocate(&allocator, p_tiles);
     }
 }
@@ -30,6 +30,8 @@
 #ifndef __bmpread_h__
 #define __bmpread_h__
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -51,6 +53,173 @@ extern "C"
 /* Load and output an alpha channel (default is just color channels). */
 #define BMPREAD_ALPHA 8u
 
+/* Output the image scaled down to 1/2, 1/4, or 1/8 of its width and height,
+ * rounding up (default is full size).  Use at most one of these.
+ */
+#define BMPREAD_SCALE_2 16u
+#define BMPREAD_SCALE_4 32u
+#define BMPREAD_SCALE_8 48u
+
+/* When scaling down, average each block of pixels (default is to take the
+ * first pixel of each block, skipping the rest).
+ */
+#define BMPREAD_SCALE_AVERAGE 64u
+
+/* Output color channels in blue, green, red order (default is red, green,
+ * blue).  24-bit files, and 32-bit files whose masks match the channel order,
+ * load without any decoding at all.
+ */
+#define BMPREAD_BGR 128u
+
+/* Output alpha before the color channels, as in ARGB, or ABGR with
+ * BMPREAD_BGR (default is alpha last).  Has no effect without BMPREAD_ALPHA.
+ */
+#define BMPREAD_ALPHA_FIRST 256u
+
+/* Output one luma channel instead of three color channels, followed (or
+ * preceded, with BMPREAD_ALPHA_FIRST) by alpha if BMPREAD_ALPHA is set
+ * (default is color).
+ */
+#define BMPREAD_GRAY 512u
+
+/* Output just one alpha channel, as if with BMPREAD_ALPHA (default is color
+ * channels).  Overrides all other format flags.
+ */
+#define BMPREAD_ALPHA_ONLY 1024u
+
+/* For 1-, 4-, and 8-bit files, output each pixel's palette index as one byte,
+ * and the palette itself separately (default is looking up each pixel's
+ * color).  The other format flags apply to the palette's entries.  Can't be
+ * combined with BMPREAD_SCALE_AVERAGE, and other files fail to load.
+ */
+#define BMPREAD_INDEXED 2048u
+
+/* Output each channel in its own plane: all of the first channel's lines,
+ * then all of the second's, and so on, in the order the channels would
+ * otherwise be in each pixel (default is channels interleaved in each pixel).
+ */
+#define BMPREAD_PLANAR 4096u
+
+/* Output each component as a native-endian 16-bit unsigned integer, or as a
+ * float from 0 to 1, instead of a byte (default is bytes).  Components the
+ * file stores with more than 8 bits keep up to 16 of them.  Narrower ones,
+ * like the 5- and 6-bit channels of 16-bit files, are also rescaled from
+ * their own bit width rather than from the byte they'd otherwise be, so they
+ * aren't always that byte times 257: a 5-bit 24 is 50737, not 198 * 257.
+ * Use at most one of these; BMPREAD_FLOAT wins if both are set.
+ */
+#define BMPREAD_UINT16 8192u
+#define BMPREAD_FLOAT 16384u
+
+/* Convert the color components from sRGB to linear light, as for blending or
+ * filtering (default is leaving them as the file has them).  Alpha isn't
+ * converted.  Best combined with BMPREAD_UINT16 or BMPREAD_FLOAT, since dark
+ * colors lose precision in a byte.
+ */
+#define BMPREAD_LINEAR 32768u
+
+/* Multiply each color component by alpha, rounding to nearest, for blending
+ * with premultiplied alpha (default is straight alpha).  With BMPREAD_LINEAR,
+ * colors are multiplied after they're converted.  Has no effect without
+ * BMPREAD_ALPHA, or on files without alpha.
+ */
+#define BMPREAD_PREMULTIPLY 65536u
+
+/* Output the image mirrored left to right (default is as stored).  When
+ * combined with a rotation, the image is mirrored first.
+ */
+#define BMPREAD_MIRROR 131072u
+
+/* Output the image turned clockwise by 90, 180, or 270 degrees (default is
+ * upright).  Use at most one of these.  The image is turned as it's seen,
+ * whichever order its lines are output in: turned by 90 degrees, its bottom
+ * line becomes its left column.  A region passed to bmpread_region() is in the
+ * turned image's coordinates, as are the width and height in bmpread_t.
+ * bmpread_open() and bmpread_tiles_open() can't turn by 90 or 270 degrees.
+ */
+#define BMPREAD_ROTATE_90 262144u
+#define BMPREAD_ROTATE_180 524288u
+#define BMPREAD_ROTATE_270 786432u
+
+/* Output a full chain of mipmaps after the image: each level half the width
+ * and height of the one before it, rounding down, until it's 1x1 (default is
+ * just the image).  Each pixel averages a 2x2 block of the level before.  The
+ * levels are made as the image is decoded, while its lines are in cache.  Get
+ * at them with bmpread_level().  Can't be combined with BMPREAD_INDEXED.
+ */
+#define BMPREAD_MIPMAPS 1048576u
+
+/* Output images whose width or height isn't a power of 2 padded out to the
+ * next power of 2, instead of failing to load them (default is to fail
+ * without BMPREAD_ANY_SIZE).  The image fills data's first columns and lines,
+ * and the rest is 0, or with BMPREAD_PAD_CLAMP, a copy of the nearest pixel on
+ * the image's edge.  Each line is padded right as it's decoded.  bmpread_t's
+ * width and height are the padded size, and image_width and image_height the
+ * image's.  bmpread_open(), bmpread_tiles_open(), and bmpread_atlas() can't
+ * pad.
+ */
+#define BMPREAD_PAD_POW2 2097152u
+#define BMPREAD_PAD_CLAMP 4194304u
+
+/* Compute a CRC-32C checksum of the image's pixels into bmpread_t's checksum
+ * (default is 0 there), for telling images apart without going over them
+ * again.  Each line is hashed right as it's decoded.  bmpread_open(),
+ * bmpread_tiles_open(), and bmpread_atlas() can't compute it.
+ */
+#define BMPREAD_CHECKSUM 8388608u
+
+/* Gather a histogram and other statistics of each channel of the image's
+ * pixels into bmpread_t's stats (default is NULL there), including whether
+ * any pixel is transparent at all.  Each line is counted right as it's
+ * decoded; indexed images count each index, then look them up in the palette
+ * once.  bmpread_open(), bmpread_tiles_open(), and bmpread_atlas() can't
+ * gather them.
+ */
+#define BMPREAD_STATS 16777216u
+
+/* With BMPREAD_ALPHA, drop the alpha channel from the output after all if
+ * every pixel's alpha turns out full (default keeps it).  The output is
+ * compacted in place once decoded, and bmpread_t's flags then leave out
+ * BMPREAD_ALPHA and BMPREAD_ALPHA_FIRST.  Alpha is checked right as each
+ * line is decoded; with BMPREAD_INDEXED, every palette entry's is checked
+ * instead, and only the palette is compacted.  Can't be used with
+ * BMPREAD_CHECKSUM when alpha could be dropped, and bmpread_open(),
+ * bmpread_tiles_open(), and bmpread_atlas() can't drop it.
+ */
+#define BMPREAD_DROP_OPAQUE_ALPHA 33554432u
+
+
+/* Statistics of an image's pixels, gathered with BMPREAD_STATS.  Channels are
+ * counted in the order they come in each of data's pixels (or planes, with
+ * BMPREAD_PLANAR).  With BMPREAD_INDEXED, they're the channels of palette's
+ * entries, and each pixel counts as the color its index stands for.  Entries
+ * past the channels counted are 0.
+ */
+typedef struct bmpread_stats_t
+{
+    int channels; /* How many channels were counted (1-4). */
+    int alpha;    /* Which of them is alpha, or -1 if none is. */
+
+    /* How many pixels have each value of each channel.  16-bit and float
+     * components are scaled to 0-255 first, rounding to nearest.
+     */
+    unsigned long histogram[4][256];
+
+    /* The smallest, biggest, and average value of each channel, on the same
+     * scale as data's components: 0-255, 0-65535 with BMPREAD_UINT16, or 0-1
+     * with BMPREAD_FLOAT.
+     */
+    double min[4];
+    double max[4];
+    double mean[4];
+
+    /* Nonzero if every pixel's alpha is full, as when there's no alpha
+     * channel, or 0 if any pixel is at all transparent.
+     */
+    int opaque;
+
+} bmpread_stats_t;
+
 
 /* The struct filled by bmpread().  Holds information about the image's pixels.
  */
@@ -60,7 +229,8 @@ typedef struct bmpread_t
     int height; /* Height in pixels. */
 
     /* BMPREAD_* flags, defined above, combined with bitwise OR, that affect
-     * the format of data.  These are set to the flags passed to bmpread().
+     * the format of data.  These are set to the flags passed to bmpread(),
+     * less any alpha flags BMPREAD_DROP_OPAQUE_ALPHA dropped.
      */
     unsigned int flags;
 
@@ -69,7 +239,18 @@ typedef struct bmpread_t
      * By default, each pixel spans three bytes: the red, green, and blue color
      * components in that order.  However, with BMPREAD_ALPHA set in flags,
      * each pixel spans four bytes: the red, green, blue, and alpha components
-     * in that order.
+     * in that order.  BMPREAD_BGR and BMPREAD_ALPHA_FIRST change the order.
+     * With BMPREAD_GRAY, the color components are replaced by a single luma
+     * component, and with BMPREAD_ALPHA_ONLY, each pixel is just one byte of
+     * alpha.
+     *
+     * With BMPREAD_UINT16 or BMPREAD_FLOAT, each component is instead a
+     * uint16_t or a float, in the host's byte order, so each pixel spans two
+     * or four times as many bytes.  data is aligned for either type.
+     *
+     * With BMPREAD_PLANAR, data instead holds one plane per component, one
+     * after another.  Each plane is laid out like an image with a single
+     * component per pixel, following all the rules below.
      *
      * Pixels are ordered left to right sequentially.  By default, the bottom
      * line comes first, proceeding upward.  However, with BMPREAD_TOP_DOWN set
@@ -84,9 +265,52 @@ typedef struct bmpread_t
      * with 3 bytes up to the next multiple of 4).  However, this behavior is
      * disabled with BMPREAD_BYTE_ALIGN set in flags, in which case all lines
      * span exactly width * pixel_span bytes.
+     *
+     * With BMPREAD_MIPMAPS, each smaller level follows, laid out the same way
+     * as an image of its size.
      */
     unsigned char * data;
 
+    /* How many entries palette has: 2, 16, or 256 with BMPREAD_INDEXED, or 0
+     * otherwise.
+     */
+    int colors;
+
+    /* With BMPREAD_INDEXED, the colors that data's indices stand for.  Each
+     * entry is laid out exactly like a pixel would be without
+     * BMPREAD_INDEXED, one right after the other.  Entries past the ones the
+     * file defines are black.  NULL without BMPREAD_INDEXED.  Freed along with
+     * data.
+     */
+    unsigned char * palette;
+
+    /* How many mipmap levels data holds, counting the image itself: 1 plus
+     * log2 of the bigger of width and height, rounded down, with
+     * BMPREAD_MIPMAPS, or 1 otherwise.
+     */
+    int levels;
+
+    /* How many of data's columns and lines, from the first, the image itself
+     * fills: fewer than width and height when padded with BMPREAD_PAD_POW2,
+     * or the same otherwise.
+     */
+    int image_width;
+    int image_height;
+
+    /* With BMPREAD_CHECKSUM, the CRC-32C (Castagnoli) of data's pixels: each
+     * line's width * pixel_span bytes, leaving out any padding that rounds
+     * lines up to four bytes, in the order they're in data.  Any mipmaps
+     * aren't included, and nor is the palette.  The same as the CRC-32C of
+     * data loaded with BMPREAD_BYTE_ALIGN.  0 without BMPREAD_CHECKSUM.
+     */
+    unsigned long checksum;
+
+    /* With BMPREAD_STATS, statistics of the image's pixels, leaving out any
+     * padding and mipmaps.  NULL without BMPREAD_STATS.  Freed along with
+     * data.
+     */
+    bmpread_stats_t * stats;
+
 } bmpread_t;
 
 
@@ -121,9 +345,18 @@ typedef struct bmpread_t
  *    no padding, pass BMPREAD_BYTE_ALIGN in flags.
  *  - Images with a width or height that isn't a power of 2 will fail to load.
  *    To allow loading images of any size, pass BMPREAD_ANY_SIZE in flags.
+ *    To pad them out to a usable size instead, pass BMPREAD_PAD_POW2.
  * Note that passing any of these flags may cause the output to be unusable as
  * an OpenGL texture, which may or may not matter to you.
  *
+ * Passing one of the BMPREAD_SCALE_* flags outputs a smaller image, such as a
+ * thumbnail, without ever decoding the image at full size.  The power of 2
+ * requirement applies to the scaled size.  By default, each output pixel is
+ * just the first pixel (in output order) of the block it stands for, which
+ * costs less than decoding the image at full size; with BMPREAD_SCALE_AVERAGE,
+ * it's the average of the whole block, which looks better but costs a little
+ * more than a full decode.
+ *
  * Most bitmap files can't include an alpha channel, so the default behavior is
  * to ignore any alpha values present in the file.  Pass BMPREAD_ALPHA in flags
  * to capture alpha values from the file; in case of an absent alpha channel,
@@ -134,12 +367,232 @@ typedef struct bmpread_t
 int bmpread(const char * bmp_file, unsigned int flags, bmpread_t * p_bmp_out);
 
 
-/* Frees memory allocated during bmpread().  Call bmpread_free() when you are
- * done using the bmpread_t struct (e.g. after you have passed the data on to
- * OpenGL).
+/* Loads just a rectangular region of the specified bitmap file, reading and
+ * decoding only the parts of the file that hold it.
+ *
+ * Inputs:
+ * bmp_file - The filename of the bitmap file to load.
+ * flags - Any BMPREAD_* flags, defined above, combined with bitwise OR.  These
+ *         mean the same thing they do for bmpread(), except that without
+ *         BMPREAD_ANY_SIZE it's the region's width and height that must be
+ *         powers of 2, not the whole image's.
+ * x - The leftmost column of the region, counting from 0.
+ * y - The first line of the region, counting from 0 in the same order lines
+ *     are output: from the bottom by default, or from the top with
+ *     BMPREAD_TOP_DOWN.
+ * width - Width of the region in pixels.
+ * height - Height of the region in pixels.
+ * p_bmp_out - Pointer to a bmpread_t struct to fill with the region, exactly
+ *             as bmpread() would fill it for an image holding only the
+ *             region's pixels.  Must be freed with bmpread_free() when no
+ *             longer needed.
+ *
+ * Returns:
+ * 0 if there's an error (file doesn't exist or is invalid, region doesn't fit
+ * inside the image, i/o error, etc.), or nonzero if the region loaded ok.
+ */
+int bmpread_region(const char * bmp_file,
+                   unsigned int flags,
+                   int x,
+                   int y,
+                   int width,
+                   int height,
+                   bmpread_t * p_bmp_out);
+
+
+/* Loads a bitmap from an already open file into memory the caller supplies,
+ * without allocating any memory at all.  Meant for places like real-time
+ * threads, where memory allocation is off limits.
  *
  * Inputs:
- * p_bmp - The pointer you previously passed to bmpread().
+ * fp - The bitmap file, a FILE * opened for reading in binary mode.  It's
+ *      passed as a void * so this header needn't include stdio.h.  The bitmap
+ *      must start at the beginning of the file; it's seeked there first.  It's
+ *      left open.  Note that stdio allocates a buffer for a file the first
+ *      time it's read from, unless you give it one with setvbuf() first.
+ * flags - Any BMPREAD_* flags, defined above, combined with bitwise OR.  These
+ *         mean the same thing they do for bmpread().
+ * scratch - Memory to use while loading, aligned for any type, like memory
+ *           from malloc().  BMPREAD_SCRATCH_SIZE(width), defined below, bytes
+ *           is always enough for a bitmap up to width pixels wide.
+ * scratch_size - How many bytes scratch holds.
+ * data - Memory to load the bitmap's pixel data into.  With BMPREAD_UINT16 or
+ *        BMPREAD_FLOAT, it must be aligned for that type.
+ * data_size - How many bytes data holds.  The bitmap fails to load if its
+ *             pixel data doesn't fit.
+ * p_bmp_out - Pointer to a bmpread_t struct to fill with information, as with
+ *             bmpread().  Its data is set to the data passed in, and its
+ *             palette and stats, if any, point into scratch.  Don't pass it
+ *             to bmpread_free().
+ *
+ * Returns:
+ * 0 if there's an error (file is invalid, scratch or data too small, i/o
+ * error, etc.), or nonzero if the file loaded ok.
+ */
+int bmpread_into(void * fp,
+                 unsigned int flags,
+                 void * scratch,
+                 size_t scratch_size,
+                 unsigned char * data,
+                 size_t data_size,
+                 bmpread_t * p_bmp_out);
+
+/* The most scratch memory, in bytes, bmpread_into() takes for each of the
+ * buffers it can need, with any flags.  BMPREAD_SCRATCH_SIZE(), below, adds
+ * them all up, since one load can need every one of them:
+ *
+ * BMPREAD_SCRATCH_PIXEL - One pixel of output or of summed averages: 4
+ *                         channels, each a float at most.
+ * BMPREAD_SCRATCH_PALETTE - The file's palette, 256 colors of 4 bytes.
+ * BMPREAD_SCRATCH_PALETTE_OUT - The palette BMPREAD_INDEXED outputs, 256
+ *                               colors of a pixel each.
+ * BMPREAD_SCRATCH_CRC - BMPREAD_CHECKSUM's table of 1024 CRCs, and a matrix
+ *                       of 32 more for each bit of the number of lines
+ *                       hashed, which takes up to 34 bits.
+ * BMPREAD_SCRATCH_STATS - BMPREAD_STATS's statistics, and how many of each
+ *                         index there are, for BMPREAD_INDEXED.
+ * BMPREAD_SCRATCH_FILE_LINE(width) - A line of the file: 4 bytes a pixel.
+ * BMPREAD_SCRATCH_LINE(width) - A decoded line, to average with
+ *                               BMPREAD_SCALE_AVERAGE.
+ * BMPREAD_SCRATCH_SUMS(width) - The averages' sums, a pixel for every 2 of the
+ *                               file's, rounded up.
+ * BMPREAD_SCRATCH_BAND(width) - BMPREAD_SCRATCH_BAND_LINES decoded lines
+ *                               waiting to be turned by BMPREAD_ROTATE_90 or
+ *                               BMPREAD_ROTATE_270.
+ * BMPREAD_SCRATCH_ALIGN - Bytes up to which each of these 8 buffers is
+ *                         rounded to keep the next aligned.
+ */
+#define BMPREAD_SCRATCH_PIXEL       16
+#define BMPREAD_SCRATCH_PALETTE     (256 * 4)
+#define BMPREAD_SCRATCH_PALETTE_OUT (256 * BMPREAD_SCRATCH_PIXEL)
+#define BMPREAD_SCRATCH_CRC         ((1024 + 34 * 32) * 4)
+#define BMPREAD_SCRATCH_STATS       (sizeof(bmpread_stats_t) + \
+                                     256 * sizeof(unsigned long))
+#define BMPREAD_SCRATCH_BAND_LINES  8
+#define BMPREAD_SCRATCH_ALIGN       16
+
+#define BMPREAD_SCRATCH_FILE_LINE(width) (4 * (size_t)(width))
+#define BMPREAD_SCRATCH_LINE(width) (BMPREAD_SCRATCH_PIXEL * (size_t)(width))
+#define BMPREAD_SCRATCH_SUMS(width) \
+    (BMPREAD_SCRATCH_PIXEL * (((size_t)(width) + 1) / 2))
+#define BMPREAD_SCRATCH_BAND(width) \
+    (BMPREAD_SCRATCH_BAND_LINES * BMPREAD_SCRATCH_LINE(width))
+
+/* How many bytes of scratch memory bmpread_into() needs at most, for any
+ * bitmap up to the given width in pixels, with any flags.
+ */
+#define BMPREAD_SCRATCH_SIZE(width)                                    \
+    (BMPREAD_SCRATCH_PALETTE + BMPREAD_SCRATCH_PALETTE_OUT +           \
+     BMPREAD_SCRATCH_CRC + BMPREAD_SCRATCH_STATS +                     \
+     BMPREAD_SCRATCH_FILE_LINE(width) + BMPREAD_SCRATCH_LINE(width) +  \
+     BMPREAD_SCRATCH_SUMS(width) + BMPREAD_SCRATCH_BAND(width) +       \
+     8 * BMPREAD_SCRATCH_ALIGN)
+
+
+/* Loads a bitmap resized to the given width and height, decoding it a line at
+ * a time and resampling as it goes, so the full size image is never held in
+ * memory.  Shrinking averages the pixels each output pixel covers; growing
+ * interpolates bilinearly.  Either can happen along each axis.
+ *
+ * Inputs:
+ * bmp_file - The filename of the bitmap file to load.
+ * flags - Any BMPREAD_* flags, defined above, combined with bitwise OR.  These
+ *         mean the same thing they do for bmpread(), and apply before
+ *         resizing, except that without BMPREAD_ANY_SIZE it's the new width
+ *         and height that must be powers of 2, not the image's.
+ *         BMPREAD_SCALE_* shrinks the image cheaply first, which is worth it
+ *         when the new size is much smaller.  BMPREAD_INDEXED,
+ *         BMPREAD_ROTATE_90, and BMPREAD_ROTATE_270 can't be used.
+ * width - Width to resize to, in pixels.
+ * height - Height to resize to, in pixels.
+ * p_bmp_out - Pointer to a bmpread_t struct to fill with the resized image,
+ *             exactly as bmpread() would fill it for an image that size.
+ *             Must be freed with bmpread_free() when no longer needed.
+ *
+ * Returns:
+ * 0 if there's an error (file doesn't exist or is invalid, flags can't be
+ * used, i/o error, etc.), or nonzero if the image loaded ok.
+ *
+ * Notes:
+ * Components are resampled as they're output, so with BMPREAD_LINEAR they're
+ * blended in linear light, and with BMPREAD_PREMULTIPLY, premultiplied.
+ */
+int bmpread_resized(const char * bmp_file,
+                    unsigned int flags,
+                    int width,
+                    int height,
+                    bmpread_t * p_bmp_out);
+
+
+/* Where bmpread_atlas() put one image in the atlas.
+ */
+typedef struct bmpread_rect_t
+{
+    int x;      /* Leftmost column. */
+    int y;      /* First line, counting in the same order lines are output. */
+    int width;  /* Width in pixels. */
+    int height; /* Height in pixels. */
+
+} bmpread_rect_t;
+
+/* Loads many small bitmaps into one atlas image, side by side.  Only their
+ * headers are read at first, to lay them out; then each is decoded straight
+ * into its place, reusing the same buffers for all of them.  Images are
+ * packed in rows, tallest first.
+ *
+ * Inputs:
+ * bmp_files - The filenames of the bitmap files to load.
+ * count - How many filenames bmp_files holds.
+ * flags - Any BMPREAD_* flags, defined above, combined with bitwise OR.  These
+ *         mean the same thing they do for bmpread(), for each image, except
+ *         that without BMPREAD_ANY_SIZE it's the atlas's width and height
+ *         that must be powers of 2, not each image's.  The atlas is made
+ *         taller to suit.  BMPREAD_INDEXED, BMPREAD_MIPMAPS,
+ *         BMPREAD_PAD_POW2, BMPREAD_CHECKSUM, BMPREAD_STATS, and
+ *         BMPREAD_DROP_OPAQUE_ALPHA can't be used.
+ * width - Width of the atlas in pixels.  Each image must fit across it.
+ * p_atlas_out - Pointer to a bmpread_t struct to fill with the atlas, laid
+ *               out as bmpread() would lay out an image its size.  Pixels no
+ *               image covers are 0.  Must be freed with bmpread_free() when
+ *               no longer needed.
+ * p_rects_out - Array of count bmpread_rect_t structs to fill with where each
+ *               image went, in the same order as bmp_files.
+ *
+ * Returns:
+ * 0 if there's an error (any file doesn't exist or is invalid, an image is
+ * too wide, i/o error, etc.), or nonzero if the atlas loaded ok.
+ */
+int bmpread_atlas(const char * const * bmp_files,
+                  int count,
+                  unsigned int flags,
+                  int width,
+                  bmpread_t * p_atlas_out,
+                  bmpread_rect_t * p_rects_out);
+
+
+/* Finds one mipmap level of an image loaded with BMPREAD_MIPMAPS.
+ *
+ * Inputs:
+ * p_bmp - The image, as filled in by bmpread() or any of the functions like
+ *         it.
+ * level - Which level, counting from 0 for the image itself.
+ * p_level_out - Pointer to a bmpread_t struct to fill with the level, as if it
+ *               were an image of its own with 1 level.  Its data points into
+ *               p_bmp's: don't pass it to bmpread_free().
+ *
+ * Returns:
+ * 0 if there's no such level, or nonzero if p_level_out was filled in.
+ */
+int bmpread_level(const bmpread_t * p_bmp, int level, bmpread_t * p_level_out);
+
+
+/* Frees memory allocated during bmpread() or any of the functions like it.
+ * Call bmpread_free() when you are done using the bmpread_t struct (e.g.
+ * after you have passed the data on to OpenGL).
+ *
+ * Inputs:
+ * p_bmp - The pointer you previously passed to bmpread(), bmpread_region(),
+ *         bmpread_resized(), or bmpread_atlas().
  *
  * Returns:
  * void
@@ -147,6 +600,307 @@ int bmpread(const char * bmp_file, unsigned int flags, bmpread_t * p_bmp_out);
 void bmpread_free(bmpread_t * p_bmp);
 
 
+/* A memory allocator for libbmpread to use in place of malloc() and free().
+ */
+typedef struct bmpread_allocator_t
+{
+    /* Allocates size bytes, like malloc(), returning NULL if out of memory.
+     * user is the user pointer below.
+     */
+    void * (* allocate)(size_t size, void * user);
+
+    /* Frees memory returned by allocate, like free().  ptr is never NULL.
+     * user is the user pointer below.
+     */
+    void (* deallocate)(void * ptr, void * user);
+
+    /* Passed along to the above functions, for any purpose you like. */
+    void * user;
+
+} bmpread_allocator_t;
+
+
+/* Sets the allocator libbmpread uses for all its memory, except for contexts
+ * created with bmpread_ctx_new_with_allocator().
+ *
+ * Inputs:
+ * p_alloc - Pointer to the allocator to use, which is copied.  NULL restores
+ *           the default of malloc() and free().
+ *
+ * Returns:
+ * void
+ *
+ * Notes:
+ * Memory is always freed with the allocator that was set when it was
+ * allocated, except for the data and palette of images bmpread_free() frees,
+ * which it frees with the allocator set at the time.  So either set the
+ * allocator once before loading anything, or free any such data before
+ * changing it.  Changing the allocator isn't thread-safe.
+ */
+void bmpread_set_allocator(const bmpread_allocator_t * p_alloc);
+
+
+/* Buffers for loading bitmaps, kept around between loads so that loading many
+ * bitmaps doesn't have to allocate memory for each one.  Its contents are
+ * private; create one with bmpread_ctx_new().
+ */
+typedef struct bmpread_ctx_t bmpread_ctx_t;
+
+
+/* Creates a new, empty bmpread_ctx_t, using the allocator currently set by
+ * bmpread_set_allocator().
+ *
+ * Returns:
+ * A new bmpread_ctx_t, which must be freed with bmpread_ctx_free() when no
+ * longer needed, or NULL if out of memory.
+ */
+bmpread_ctx_t * bmpread_ctx_new(void);
+
+
+/* Creates a new, empty bmpread_ctx_t that allocates its memory (including the
+ * context itself) with the given allocator, instead of the one set by
+ * bmpread_set_allocator().
+ *
+ * Inputs:
+ * p_alloc - Pointer to the allocator to use, which is copied.  NULL means to
+ *           use the one currently set by bmpread_set_allocator(), same as
+ *           bmpread_ctx_new().
+ *
+ * Returns:
+ * A new bmpread_ctx_t, which must be freed with bmpread_ctx_free() when no
+ * longer needed, or NULL if out of memory.
+ */
+bmpread_ctx_t * bmpread_ctx_new_with_allocator(
+        const bmpread_allocator_t * p_alloc);
+
+
+/* Loads the specified bitmap file from disk just like bmpread(), but using the
+ * given context's buffers, which only need to grow if this bitmap is bigger
+ * than any the context has loaded before.
+ *
+ * Inputs:
+ * p_ctx - The context returned by bmpread_ctx_new().
+ * bmp_file - The filename of the bitmap file to load.
+ * flags - Any BMPREAD_* flags, defined above, combined with bitwise OR.
+ * p_bmp_out - Pointer to a bmpread_t struct to fill with information, as with
+ *             bmpread().  Its data, palette, and stats belong to the
+ *             context: don't pass it to bmpread_free().  They stay valid
+ *             until the next bmpread_ctx_read() or bmpread_ctx_free() call on
+ *             the same context.
+ *
+ * Returns:
+ * 0 if there's an error (file doesn't exist or is invalid, i/o error, etc.),
+ * or nonzero if the file loaded ok.
+ */
+int bmpread_ctx_read(bmpread_ctx_t * p_ctx,
+                     const char * bmp_file,
+                     unsigned int flags,
+                     bmpread_t * p_bmp_out);
+
+
+/* Sets lookup tables that bmpread_ctx_read() runs each color component
+ * through as it decodes, such as a gamma or tone curve.  Alpha isn't looked
+ * up.
+ *
+ * Inputs:
+ * p_ctx - The context returned by bmpread_ctx_new().
+ * red - A table of 256 entries, giving the output value for each 8-bit red
+ *       value.  The table is copied.  NULL removes any tables from the
+ *       context.
+ * green - The same, for green.  NULL means to use red's table.
+ * blue - The same, for blue.  NULL means to use red's table.
+ *
+ * Returns:
+ * void
+ *
+ * Notes:
+ * Tables are applied before BMPREAD_GRAY, BMPREAD_LINEAR, and
+ * BMPREAD_PREMULTIPLY.  For 1-, 4-, and 8-bit files, they're applied to the
+ * palette instead of each pixel, so they cost nothing per pixel.  Components
+ * with more than 8 bits, with BMPREAD_UINT16 or BMPREAD_FLOAT, are
+ * interpolated between the two nearest entries, so an identity table leaves
+ * them unchanged.  Only bmpread_ctx_read() applies tables: bmpread(),
+ * bmpread_region(), bmpread_into(), bmpread_resized(), bmpread_atlas(),
+ * bmpread_open(), and bmpread_tiles_open() take no context to find them in.
+ */
+void bmpread_ctx_set_lut(bmpread_ctx_t * p_ctx,
+                         const unsigned char * red,
+                         const unsigned char * green,
+                         const unsigned char * blue);
+
+
+/* Sets a color key for bmpread_ctx_read(): with BMPREAD_ALPHA (or
+ * BMPREAD_ALPHA_ONLY), pixels of exactly this color get an alpha of 0, and
+ * every other pixel is fully opaque, whatever alpha the file has.
+ *
+ * Inputs:
+ * p_ctx - The context returned by bmpread_ctx_new().
+ * rgb - The key color, as 0xRRGGBB, such as 0xff00ff for magenta.  Compared
+ *       with each pixel's color as the file has it, before any tables from
+ *       bmpread_ctx_set_lut(), with components of fewer than 8 bits filled
+ *       out to 8.  -1 removes the key.
+ *
+ * Returns:
+ * void
+ *
+ * Notes:
+ * For 1-, 4-, and 8-bit files, the key is applied to the palette instead of
+ * each pixel, so it costs nothing per pixel.  With BMPREAD_PREMULTIPLY, keyed
+ * pixels come out black.  Like tables, keys are only applied by
+ * bmpread_ctx_read(), since the other loading functions take no context.
+ */
+void bmpread_ctx_set_color_key(bmpread_ctx_t * p_ctx, long rgb);
+
+
+/* Frees a context created by bmpread_ctx_new(), including the data of the last
+ * bitmap it loaded.
+ *
+ * Inputs:
+ * p_ctx - The context returned by bmpread_ctx_new().  NULL is ignored.
+ *
+ * Returns:
+ * void
+ */
+void bmpread_ctx_free(bmpread_ctx_t * p_ctx);
+
+
+/* A bitmap file being read one row at a time.  Its contents are private;
+ * create one with bmpread_open().
+ */
+typedef struct bmpread_stream_t bmpread_stream_t;
+
+
+/* Opens and validates the specified bitmap file for reading one row at a time
+ * with bmpread_next_row(), without ever holding more than a row of decoded
+ * pixels in memory.
+ *
+ * Inputs:
+ * bmp_file - The filename of the bitmap file to load.
+ * flags - Any BMPREAD_* flags, defined above, combined with bitwise OR.  These
+ *         mean the same thing they do for bmpread().
+ * p_bmp_out - Pointer to a bmpread_t struct to fill with the image's width,
+ *             height, and flags.  Its data is always set to NULL; rows come
+ *             from bmpread_next_row() instead.  Doesn't need to be freed.  Its
+ *             palette, if any, stays valid until bmpread_close().
+ *
+ * Returns:
+ * A new bmpread_stream_t, which must be freed with bmpread_close() when no
+ * longer needed, or NULL if there's an error (file doesn't exist or is
+ * invalid, out of memory, etc.).
+ */
+bmpread_stream_t * bmpread_open(const char * bmp_file,
+                                unsigned int flags,
+                                bmpread_t * p_bmp_out);
+
+
+/* Decodes the next row of a bitmap opened with bmpread_open().
+ *
+ * Inputs:
+ * p_stream - The stream returned by bmpread_open().
+ *
+ * Returns:
+ * A pointer to the row's pixel data, or NULL if there's an error or all rows
+ * have already been read.  Each row is laid out exactly like a line of
+ * bmpread_t's data would be with the same flags, and rows come in the same
+ * order they would there.  The buffer is reused for the next row, and freed by
+ * bmpread_close().
+ *
+ * Notes:
+ * Rows are cheapest to read in the order they're stored in the file, which for
+ * most bitmaps is bottom line first, the default.  Asking for the opposite
+ * order (e.g. with BMPREAD_TOP_DOWN) works, but costs a seek for each row.
+ */
+const unsigned char * bmpread_next_row(bmpread_stream_t * p_stream);
+
+
+/* Closes a bitmap opened with bmpread_open() and frees its memory.
+ *
+ * Inputs:
+ * p_stream - The stream returned by bmpread_open().  NULL is ignored.
+ *
+ * Returns:
+ * void
+ */
+void bmpread_close(bmpread_stream_t * p_stream);
+
+
+
+/* A bitmap file being read one tile at a time, with a cache of recently read
+ * tiles.  Its contents are private; create one with bmpread_tiles_open().
+ */
+typedef struct bmpread_tiles_t bmpread_tiles_t;
+
+
+/* Opens and validates the specified bitmap file for reading square tiles of it
+ * on demand with bmpread_tile(), decoding only the parts of the file each tile
+ * needs.  This is useful for viewing images far too big to decode at once.
+ *
+ * Inputs:
+ * bmp_file - The filename of the bitmap file to load.
+ * flags - Any BMPREAD_* flags, defined above, combined with bitwise OR.  These
+ *         mean the same thing they do for bmpread(), and apply to each tile as
+ *         if it were an image of its own.  Tiles are cut from the image as
+ *         scaled by any BMPREAD_SCALE_* flags.
+ * tile_size - The width and height of each tile in pixels.  Tiles at the
+ *             right and top (or bottom) edges of the image are cut short.
+ *             Must be a power of 2 unless BMPREAD_ANY_SIZE is in flags.
+ * cache_size - How many bytes of tile data to keep around for reuse.  The
+ *              least recently used tiles are replaced once it's full.  At
+ *              least one tile is always kept.
+ * p_bmp_out - Pointer to a bmpread_t struct to fill with the width, height,
+ *             and flags of the whole (possibly scaled) image.  Its data is
+ *             always set to NULL.  Doesn't need to be freed.  Its palette, if
+ *             any, stays valid until bmpread_tiles_close().
+ *
+ * Returns:
+ * A new bmpread_tiles_t, which must be freed with bmpread_tiles_close() when
+ * no longer needed, or NULL if there's an error (file doesn't exist or is
+ * invalid, out of memory, etc.).
+ */
+bmpread_tiles_t * bmpread_tiles_open(const char * bmp_file,
+                                     unsigned int flags,
+                                     int tile_size,
+                                     unsigned long cache_size,
+                                     bmpread_t * p_bmp_out);
+
+
+/* Gets a tile of a bitmap opened with bmpread_tiles_open(), decoding it unless
+ * it's still in the cache.
+ *
+ * Inputs:
+ * p_tiles - The reader returned by bmpread_tiles_open().
+ * column - Which tile across, counting from 0 at the left.
+ * row - Which tile up or down, counting from 0 in the same order lines are
+ *       output: from the bottom by default, or from the top with
+ *       BMPREAD_TOP_DOWN.
+ * p_tile_out - Pointer to a bmpread_t struct to fill with the tile, exactly as
+ *              bmpread() would fill it for an image holding only the tile's
+ *              pixels.  Its data belongs to the reader: don't pass it to
+ *              bmpread_free().  It stays valid until the next bmpread_tile()
+ *              or bmpread_tiles_close() call on the same reader.
+ *
+ * Returns:
+ * 0 if there's an error (tile outside the image, i/o error, etc.), or nonzero
+ * if the tile loaded ok.
+ */
+int bmpread_tile(bmpread_tiles_t * p_tiles,
+                 int column,
+                 int row,
+                 bmpread_t * p_tile_out);
+
+
+/* Closes a bitmap opened with bmpread_tiles_open() and frees its memory,
+ * including all its tiles.
+ *
+ * Inputs:
+ * p_tiles - The reader returned by bmpread_tiles_open().  NULL is ignored.
+ *
+ * Returns:
+ * void
+ */
+void bmpread_tiles_close(bmpread_tiles_t * p_tiles);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -36,6 +36,61 @@
 
 static const char * const test_data = "./test.data";
 
+/* Bitmaps of every supported bit depth, borrowed from the example.  They're
+ * all 128x128.
+ */
+static const char * const test_bitmaps[] =
+{
+    "../example/example-1bpp.bmp",
+    "../example/example-4bpp.bmp",
+    "../example/example-8bpp.bmp",
+    "../example/example-16bpp-a1r5g5b5.bmp",
+    "../example/example-16bpp-r5g6b5.bmp",
+    "../example/example-16bpp-x1r5g5b5.bmp",
+    "../example/example-24bpp.bmp",
+    "../example/example-32bpp-a8r8g8b8.bmp",
+    "../example/example-32bpp-x8r8g8b8.bmp",
+    NULL
+};
+
+/* Items of scratch memory enough for bmpread_into() to load any of them. */
+#define SCRATCH_ITEMS (BMPREAD_SCRATCH_SIZE(128) / sizeof(max_align) + 1)
+
+/* Bytes in each component of bmpread()'s output. */
+static size_t ComponentBytes(const bmpread_t * p_bmp)
+{
+    if(p_bmp->flags & BMPREAD_INDEXED)
+        return 1;
+    if(p_bmp->flags & BMPREAD_FLOAT)
+        return sizeof(float);
+    if(p_bmp->flags & BMPREAD_UINT16)
+        return sizeof(uint16_t);
+    return 1;
+}
+
+/* Bytes of pixel data in each line of bmpread()'s output, not counting
+ * padding.
+ */
+static size_t PixelBytes(const bmpread_t * p_bmp)
+{
+    size_t channels = ((p_bmp->flags & BMPREAD_GRAY) ? 1 : 3);
+
+    if(p_bmp->flags & BMPREAD_ALPHA)
+        channels++;
+    if(p_bmp->flags & (BMPREAD_ALPHA_ONLY | BMPREAD_INDEXED | BMPREAD_PLANAR))
+        channels = 1;
+
+    return (size_t)p_bmp->width * channels * ComponentBytes(p_bmp);
+}
+
+/* Total length of each line of bmpread()'s output, including padding. */
+static size_t LineLength(const bmpread_t * p_bmp)
+{
+    if(p_bmp->flags & BMPREAD_BYTE_ALIGN)
+        return PixelBytes(p_bmp);
+    return GetLineLength(PixelBytes(p_bmp), 8);
+}
+
 
 static void test_CanAdd(void)
 {
@@ -291,6 +346,36 @@ static void test_Make8Bits(void)
     assert(Make8Bits(0xa, 4) == 0xaa);
 
     assert(Make8Bits(0xa5ffffff, 32) == 0xa5);
+
+    assert(MakeBits(0x1,  1, 16) == 0xffff);
+    assert(MakeBits(0x10, 5, 16) == 0x8421);
+    assert(MakeBits(0x3f, 6, 16) == 0xffff);
+    assert(MakeBits(0xab, 8, 16) == 0xabab);
+    assert(MakeBits(0xa5c3ffff, 32, 16) == 0xa5c3);
+}
+
+static void test_Linearize(void)
+{
+    read_context ctx;
+    uint32_t v;
+
+    memset(&ctx, 0, sizeof(ctx));
+    BuildLinearTable(&ctx);
+
+    ctx.comp_bits = 8;
+    assert(Linearize(&ctx, 0) == 0.0f);
+    assert(Linearize(&ctx, 255) > 0.99999f && Linearize(&ctx, 255) < 1.00001f);
+    assert(Linearize(&ctx, 10) > 0.003035f && Linearize(&ctx, 10) < 0.003036f);
+    assert(Linearize(&ctx, 128) > 0.21586f && Linearize(&ctx, 128) < 0.21587f);
+    for(v = 1; v < 256; v++)
+        assert(Linearize(&ctx, v) > Linearize(&ctx, v - 1));
+
+    /* 16-bit components land on the table at multiples of 257. */
+    ctx.comp_bits = 16;
+    assert(Linearize(&ctx, 128 * 257) == ctx.to_linear[128]);
+    assert(Linearize(&ctx, 65535) == ctx.to_linear[255]);
+    for(v = 1; v < 65536; v++)
+        assert(Linearize(&ctx, v) >= Linearize(&ctx, v - 1));
 }
 
 static void test_LoadLittleUint32(void)
@@ -305,6 +390,3007 @@ static void test_LoadLittleUint16(void)
     assert(LoadLittleUint16(buf) == 0x0201);
 }
 
+static void test_ValidateInPlace(void)
+{
+    static const unsigned int flags[] =
+    {
+        0,
+        BMPREAD_ALPHA,
+        BMPREAD_BYTE_ALIGN | BMPREAD_TOP_DOWN,
+        BMPREAD_ALPHA | BMPREAD_SCALE_2,
+        BMPREAD_SCALE_8
+    };
+    read_context ctx;
+    bmpread_t bmp;
+    bmpread_t copied;
+    size_t f;
+    int i;
+
+    for(i = 0; test_bitmaps[i]; i++)
+    {
+        for(f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            memset(&ctx, 0, sizeof(ctx));
+            ctx.allocator = global_allocator;
+            assert(Open(&ctx, test_bitmaps[i], flags[f]));
+
+            /* Everything but 32 bits into fewer bytes decodes in place, as
+             * long as scaling doesn't skip over more than it outputs.
+             */
+            assert(ctx.in_place ==
+                   (ctx.x_step * ctx.info.bits <= ctx.out_channels * 8));
+
+            /* Decoding from a separate buffer gives the same result. */
+            if(ctx.in_place)
+            {
+                ctx.in_place = 0;
+                assert((ctx.file_data = (uint8_t *)
+                        AllocateBuffer(&ctx, BUFFER_FILE_DATA,
+                                       ctx.span_len, 0)));
+            }
+            assert(Read(&ctx, &copied));
+            FreeContext(&ctx, 1);
+
+            assert(bmpread(test_bitmaps[i], flags[f], &bmp));
+            assert(copied.width == bmp.width && copied.height == bmp.height);
+            assert(!memcmp(copied.data, bmp.data,
+                           LineLength(&bmp) * bmp.height));
+
+            bmpread_free(&copied);
+            bmpread_free(&bmp);
+        }
+    }
+}
+
+static void test_BMPREAD_BGR(void)
+{
+    static const unsigned int flags[] =
+    {
+        0,
+        BMPREAD_ALPHA | BMPREAD_TOP_DOWN,
+        BMPREAD_BYTE_ALIGN,
+        BMPREAD_SCALE_2 | BMPREAD_SCALE_AVERAGE
+    };
+    read_context ctx;
+    bmpread_t rgb;
+    bmpread_t bgr;
+    size_t f;
+    int i;
+
+    for(i = 0; test_bitmaps[i]; i++)
+    {
+        for(f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            size_t channels = ((flags[f] & BMPREAD_ALPHA) ? 4 : 3);
+            size_t len;
+            size_t j;
+
+            assert(bmpread(test_bitmaps[i], flags[f], &rgb));
+            assert(bmpread(test_bitmaps[i], flags[f] | BMPREAD_BGR, &bgr));
+            assert(bgr.flags == (flags[f] | BMPREAD_BGR));
+            assert(bgr.width == rgb.width && bgr.height == rgb.height);
+
+            /* Line length is a multiple of the pixel size in all of these. */
+            len = LineLength(&rgb) * rgb.height;
+            for(j = 0; j < len; j += channels)
+            {
+                assert(bgr.data[j    ] == rgb.data[j + 2]);
+                assert(bgr.data[j + 1] == rgb.data[j + 1]);
+                assert(bgr.data[j + 2] == rgb.data[j    ]);
+                if(channels == 4)
+                    assert(bgr.data[j + 3] == rgb.data[j + 3]);
+            }
+
+            bmpread_free(&rgb);
+            bmpread_free(&bgr);
+        }
+    }
+
+    /* Only data already in the output format skips decoding. */
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.allocator = global_allocator;
+    assert(Open(&ctx, "../example/example-24bpp.bmp", BMPREAD_BGR));
+    assert(ctx.raw);
+    FreeContext(&ctx, 0);
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.allocator = global_allocator;
+    assert(Open(&ctx, "../example/example-24bpp.bmp", 0));
+    assert(!ctx.raw);
+    FreeContext(&ctx, 0);
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.allocator = global_allocator;
+    assert(Open(&ctx, "../example/example-32bpp-a8r8g8b8.bmp",
+                BMPREAD_BGR | BMPREAD_ALPHA));
+    assert(!ctx.raw); /* Its masks put alpha first and red last. */
+    FreeContext(&ctx, 0);
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.allocator = global_allocator;
+    assert(Open(&ctx, "../example/example-32bpp-a8r8g8b8.bmp", BMPREAD_BGR));
+    assert(!ctx.raw);
+    FreeContext(&ctx, 0);
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.allocator = global_allocator;
+    assert(Open(&ctx, "../example/example-24bpp.bmp",
+                BMPREAD_BGR | BMPREAD_SCALE_2));
+    assert(!ctx.raw);
+    FreeContext(&ctx, 0);
+}
+
+static void test_BMPREAD_ALPHA_FIRST(void)
+{
+    static const unsigned int flags[] =
+    {
+        BMPREAD_ALPHA,
+        BMPREAD_ALPHA | BMPREAD_BGR,
+        BMPREAD_ALPHA | BMPREAD_TOP_DOWN | BMPREAD_SCALE_4
+    };
+    read_context ctx;
+    bmpread_t last;
+    bmpread_t first;
+    size_t f;
+    int i;
+
+    for(i = 0; test_bitmaps[i]; i++)
+    {
+        for(f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            size_t len;
+            size_t j;
+
+            assert(bmpread(test_bitmaps[i], flags[f], &last));
+            assert(bmpread(test_bitmaps[i], flags[f] | BMPREAD_ALPHA_FIRST,
+                           &first));
+            assert(first.width == last.width && first.height == last.height);
+
+            len = LineLength(&last) * last.height;
+            for(j = 0; j < len; j += 4)
+            {
+                assert(first.data[j    ] == last.data[j + 3]);
+                assert(first.data[j + 1] == last.data[j    ]);
+                assert(first.data[j + 2] == last.data[j + 1]);
+                assert(first.data[j + 3] == last.data[j + 2]);
+            }
+
+            bmpread_free(&last);
+            bmpread_free(&first);
+        }
+
+        /* Without alpha, there's nothing to move. */
+        assert(bmpread(test_bitmaps[i], 0, &last));
+        assert(bmpread(test_bitmaps[i], BMPREAD_ALPHA_FIRST, &first));
+        assert(!memcmp(first.data, last.data,
+                       LineLength(&last) * last.height));
+        bmpread_free(&last);
+        bmpread_free(&first);
+    }
+
+    /* This file's masks put its bytes in ABGR order. */
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.allocator = global_allocator;
+    assert(Open(&ctx, "../example/example-32bpp-a8r8g8b8.bmp",
+                BMPREAD_ALPHA | BMPREAD_ALPHA_FIRST | BMPREAD_BGR));
+    assert(ctx.raw);
+    FreeContext(&ctx, 0);
+}
+
+static void test_BMPREAD_GRAY(void)
+{
+    static const unsigned int flags[] =
+    {
+        0,
+        BMPREAD_TOP_DOWN | BMPREAD_BYTE_ALIGN,
+        BMPREAD_SCALE_2 | BMPREAD_SCALE_AVERAGE
+    };
+    bmpread_t rgba;
+    bmpread_t gray;
+    bmpread_t alpha;
+    size_t f;
+    int i;
+
+    assert(Luma(0, 0, 0) == 0);
+    assert(Luma(255, 255, 255) == 255);
+    assert(Luma(255, 0, 0) == 77);
+    assert(Luma(0, 255, 0) == 149);
+    assert(Luma(0, 0, 255) == 29);
+
+    for(i = 0; test_bitmaps[i]; i++)
+    {
+        for(f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            int x;
+            int y;
+
+            assert(bmpread(test_bitmaps[i], flags[f] | BMPREAD_ALPHA, &rgba));
+            assert(bmpread(test_bitmaps[i],
+                           flags[f] | BMPREAD_GRAY | BMPREAD_ALPHA |
+                           BMPREAD_ALPHA_FIRST,
+                           &gray));
+            assert(bmpread(test_bitmaps[i], flags[f] | BMPREAD_ALPHA_ONLY,
+                           &alpha));
+            assert(gray.width == rgba.width && gray.height == rgba.height);
+            assert(alpha.width == rgba.width && alpha.height == rgba.height);
+
+            for(y = 0; y < rgba.height; y++)
+            {
+                const uint8_t * p_rgba  = rgba.data  + y * LineLength(&rgba);
+                const uint8_t * p_gray  = gray.data  + y * LineLength(&gray);
+                const uint8_t * p_alpha = alpha.data + y * LineLength(&alpha);
+
+                for(x = 0; x < rgba.width; x++)
+                {
+                    /* Averaging happens after conversion, so can round
+                     * differently.
+                     */
+                    int luma = Luma(p_rgba[0], p_rgba[1], p_rgba[2]);
+                    int diff = p_gray[1] - luma;
+                    assert((flags[f] & BMPREAD_SCALE_AVERAGE) ?
+                           diff >= -1 && diff <= 1 : diff == 0);
+
+                    assert(p_gray[0] == p_rgba[3]);
+                    assert(*p_alpha == p_rgba[3]);
+
+                    p_rgba += 4;
+                    p_gray += 2;
+                    p_alpha++;
+                }
+            }
+
+            bmpread_free(&rgba);
+            bmpread_free(&gray);
+            bmpread_free(&alpha);
+        }
+    }
+}
+
+static void test_BMPREAD_INDEXED(void)
+{
+    static const unsigned int flags[] =
+    {
+        0,
+        BMPREAD_ALPHA | BMPREAD_BGR | BMPREAD_TOP_DOWN,
+        BMPREAD_GRAY | BMPREAD_BYTE_ALIGN | BMPREAD_SCALE_4
+    };
+    bmpread_tiles_t * p_tiles;
+    read_context ctx;
+    bmpread_t color;
+    bmpread_t indexed;
+    bmpread_t tile;
+    size_t f;
+    int i;
+
+    for(i = 0; test_bitmaps[i]; i++)
+    {
+        for(f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            size_t channels;
+            int x;
+            int y;
+
+            assert(bmpread(test_bitmaps[i], flags[f], &color));
+            assert(!color.colors && !color.palette);
+
+            if(!bmpread(test_bitmaps[i], flags[f] | BMPREAD_INDEXED, &indexed))
+            {
+                /* Only files with palettes have indices. */
+                assert(i > 2);
+                bmpread_free(&color);
+                continue;
+            }
+            assert(i <= 2);
+            assert(indexed.colors == (i == 0 ? 2 : i == 1 ? 16 : 256));
+            assert(indexed.palette);
+            assert(indexed.width == color.width);
+            assert(indexed.height == color.height);
+
+            /* Looking each index up gives back the color. */
+            channels = PixelBytes(&color) / color.width;
+            for(y = 0; y < color.height; y++)
+            {
+                const uint8_t * p_color = color.data + y * LineLength(&color);
+                const uint8_t * p_index = indexed.data +
+                                          y * LineLength(&indexed);
+                for(x = 0; x < color.width; x++)
+                {
+                    assert(p_index[x] < indexed.colors);
+                    assert(!memcmp(p_color + x * channels,
+                                   indexed.palette + p_index[x] * channels,
+                                   channels));
+                }
+            }
+
+            bmpread_free(&color);
+            bmpread_free(&indexed);
+        }
+    }
+
+    assert(!bmpread("../example/example-8bpp.bmp",
+                    BMPREAD_INDEXED | BMPREAD_SCALE_2 | BMPREAD_SCALE_AVERAGE,
+                    &indexed));
+
+    /* 8-bit indices need no decoding. */
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.allocator = global_allocator;
+    assert(Open(&ctx, "../example/example-8bpp.bmp", BMPREAD_INDEXED));
+    assert(ctx.raw);
+    FreeContext(&ctx, 0);
+
+    /* Tiles come with the palette too. */
+    assert((p_tiles = bmpread_tiles_open("../example/example-4bpp.bmp",
+                                         BMPREAD_INDEXED, 32, 0, &indexed)));
+    assert(indexed.colors == 16 && indexed.palette);
+    assert(bmpread_tile(p_tiles, 1, 2, &tile));
+    assert(tile.colors == 16 && tile.palette == indexed.palette);
+    bmpread_tiles_close(p_tiles);
+}
+
+static void test_BMPREAD_PLANAR(void)
+{
+    static const unsigned int flags[] =
+    {
+        0,
+        BMPREAD_ALPHA | BMPREAD_ALPHA_FIRST | BMPREAD_TOP_DOWN,
+        BMPREAD_BGR | BMPREAD_ANY_SIZE | BMPREAD_BYTE_ALIGN,
+        BMPREAD_GRAY | BMPREAD_ALPHA | BMPREAD_SCALE_2,
+        BMPREAD_ALPHA | BMPREAD_SCALE_4 | BMPREAD_SCALE_AVERAGE
+    };
+    bmpread_stream_t * p_stream;
+    bmpread_tiles_t * p_tiles;
+    bmpread_t packed;
+    bmpread_t planar;
+    bmpread_t tile;
+    size_t f;
+    int i;
+
+    for(i = 0; test_bitmaps[i]; i++)
+    {
+        for(f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            size_t channels;
+            size_t plane_len;
+            size_t c;
+            int x;
+            int y;
+
+            assert(bmpread(test_bitmaps[i], flags[f], &packed));
+            assert(bmpread(test_bitmaps[i], flags[f] | BMPREAD_PLANAR,
+                           &planar));
+            assert(planar.width == packed.width);
+            assert(planar.height == packed.height);
+
+            channels  = PixelBytes(&packed) / packed.width;
+            plane_len = LineLength(&planar) * planar.height;
+
+            for(y = 0; y < packed.height; y++)
+            {
+                const uint8_t * p_packed = packed.data +
+                                           y * LineLength(&packed);
+                const uint8_t * p_planar = planar.data +
+                                           y * LineLength(&planar);
+
+                for(x = 0; x < packed.width; x++)
+                {
+                    for(c = 0; c < channels; c++)
+                        assert(p_planar[c * plane_len + x] ==
+                               p_packed[x * channels + c]);
+                }
+            }
+
+            /* Streamed rows hold a line of each plane. */
+            assert((p_stream = bmpread_open(test_bitmaps[i],
+                                            flags[f] | BMPREAD_PLANAR,
+                                            &tile)));
+            for(y = 0; y < planar.height; y++)
+            {
+                const uint8_t * p_row = bmpread_next_row(p_stream);
+                assert(p_row);
+                for(c = 0; c < channels; c++)
+                    assert(!memcmp(p_row + c * LineLength(&planar),
+                                   planar.data + c * plane_len +
+                                   y * LineLength(&planar),
+                                   PixelBytes(&planar)));
+            }
+            bmpread_close(p_stream);
+
+            bmpread_free(&packed);
+            bmpread_free(&planar);
+        }
+    }
+
+    /* A tile's planes are as big as the tile. */
+    assert(bmpread_region("../example/example-24bpp.bmp", BMPREAD_PLANAR,
+                          32, 16, 16, 16, &planar));
+    assert((p_tiles = bmpread_tiles_open("../example/example-24bpp.bmp",
+                                         BMPREAD_PLANAR, 16, 1 << 16,
+                                         &packed)));
+    assert(bmpread_tile(p_tiles, 2, 1, &tile));
+    assert(!memcmp(tile.data, planar.data, 16 * 16 * 3));
+    bmpread_tiles_close(p_tiles);
+    bmpread_free(&planar);
+}
+
+static void test_BMPREAD_UINT16(void)
+{
+    static max_align scratch[SCRATCH_ITEMS];
+    static float data[128 * 128 * 4];
+    bmpread_tiles_t * p_tiles;
+    bmpread_t tile;
+    FILE * fp;
+    static const unsigned int flags[] =
+    {
+        0,
+        BMPREAD_ALPHA | BMPREAD_BGR | BMPREAD_TOP_DOWN,
+        BMPREAD_ALPHA_ONLY | BMPREAD_BYTE_ALIGN,
+        BMPREAD_GRAY | BMPREAD_ALPHA | BMPREAD_PLANAR,
+        BMPREAD_ALPHA | BMPREAD_SCALE_4 | BMPREAD_SCALE_AVERAGE,
+        BMPREAD_ALPHA | BMPREAD_PLANAR | BMPREAD_SCALE_2 |
+            BMPREAD_SCALE_AVERAGE
+    };
+    bmpread_t narrow;
+    bmpread_t wide;
+    bmpread_t fl;
+    size_t f;
+    int i;
+
+    for(i = 0; test_bitmaps[i]; i++)
+    {
+        for(f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            size_t components;
+            size_t planes;
+            size_t p;
+            size_t c;
+            int y;
+
+            assert(bmpread(test_bitmaps[i], flags[f], &narrow));
+            assert(bmpread(test_bitmaps[i], flags[f] | BMPREAD_UINT16, &wide));
+            assert(bmpread(test_bitmaps[i], flags[f] | BMPREAD_FLOAT, &fl));
+            assert(wide.width == narrow.width && fl.width == narrow.width);
+            assert(wide.height == narrow.height && fl.height == narrow.height);
+
+            /* Narrow components are a byte each. */
+            components = PixelBytes(&narrow);
+            planes     = ((flags[f] & BMPREAD_PLANAR) ?
+                          (size_t)((flags[f] & BMPREAD_GRAY) ? 2 : 4) : 1);
+
+            for(p = 0; p < planes; p++)
+            {
+                for(y = 0; y < narrow.height; y++)
+                {
+                    size_t line = p * narrow.height + y;
+                    const uint8_t * p_narrow = narrow.data +
+                                               line * LineLength(&narrow);
+                    const uint16_t * p_wide = (const uint16_t *)(const void *)
+                                              (wide.data +
+                                               line * LineLength(&wide));
+                    const float * p_fl = (const float *)(const void *)
+                                         (fl.data + line * LineLength(&fl));
+
+                    for(c = 0; c < components; c++)
+                    {
+                        /* Rounding differs a little with luma and averages,
+                         * and fields under 8 bits fill more bits out.  Float
+                         * averages aren't rounded at all.
+                         */
+                        int diff = (int)p_narrow[c] - (int)(p_wide[c] / 257);
+                        assert(diff >= -1 && diff <= 1);
+
+                        assert(p_fl[c] * 65535 > p_wide[c] - 0.51f);
+                        assert(p_fl[c] * 65535 < p_wide[c] + 0.51f);
+                    }
+                }
+            }
+
+            bmpread_free(&narrow);
+            bmpread_free(&wide);
+            bmpread_free(&fl);
+        }
+    }
+
+    /* Files with 8-bit components keep them exactly. */
+    assert(bmpread("../example/example-24bpp.bmp", 0, &narrow));
+    assert(bmpread("../example/example-24bpp.bmp", BMPREAD_UINT16, &wide));
+    for(i = 0; i < narrow.width * narrow.height * 3; i++)
+        assert(((const uint16_t *)(const void *)wide.data)[i] ==
+               narrow.data[i] * 257);
+    bmpread_free(&narrow);
+    bmpread_free(&wide);
+
+    /* 5-bit channels widen straight from 5 bits, not by way of a byte. */
+    assert(bmpread("../example/example-16bpp-x1r5g5b5.bmp", 0, &narrow));
+    assert(bmpread("../example/example-16bpp-x1r5g5b5.bmp", BMPREAD_UINT16,
+                   &wide));
+    for(i = 0; i < narrow.width * narrow.height * 3; i++)
+    {
+        unsigned long value = narrow.data[i] >> 3;
+
+        assert(((const uint16_t *)(const void *)wide.data)[i] ==
+               (value * 65535 + 15) / 31);
+    }
+    bmpread_free(&narrow);
+    bmpread_free(&wide);
+
+    /* Indices stay bytes; the palette is wide. */
+    assert(bmpread("../example/example-8bpp.bmp", BMPREAD_INDEXED, &narrow));
+    assert(bmpread("../example/example-8bpp.bmp",
+                   BMPREAD_INDEXED | BMPREAD_UINT16, &wide));
+    assert(!memcmp(narrow.data, wide.data,
+                   LineLength(&narrow) * narrow.height));
+    for(i = 0; i < narrow.colors * 3; i++)
+        assert(((const uint16_t *)(const void *)wide.palette)[i] ==
+               narrow.palette[i] * 257);
+    bmpread_free(&narrow);
+    bmpread_free(&wide);
+
+    /* Tiles are laid out like regions. */
+    assert(bmpread_region("../example/example-16bpp-r5g6b5.bmp", BMPREAD_FLOAT,
+                          16, 48, 16, 16, &fl));
+    assert((p_tiles = bmpread_tiles_open("../example/example-16bpp-r5g6b5.bmp",
+                                         BMPREAD_FLOAT, 16, 1 << 16,
+                                         &narrow)));
+    assert(bmpread_tile(p_tiles, 1, 3, &tile));
+    assert(!memcmp(tile.data, fl.data, LineLength(&fl) * fl.height));
+    bmpread_tiles_close(p_tiles);
+    bmpread_free(&fl);
+
+    /* The most scratch memory wide output can take is still enough. */
+    assert((fp = fopen("../example/example-32bpp-a8r8g8b8.bmp", "rb")));
+    assert(bmpread_into(fp, BMPREAD_FLOAT | BMPREAD_ALPHA | BMPREAD_SCALE_2 |
+                            BMPREAD_SCALE_AVERAGE,
+                        scratch, BMPREAD_SCRATCH_SIZE(128),
+                        (unsigned char *)data, sizeof(data), &wide));
+    fclose(fp);
+    assert((fp = fopen("../example/example-8bpp.bmp", "rb")));
+    assert(bmpread_into(fp, BMPREAD_FLOAT | BMPREAD_ALPHA | BMPREAD_INDEXED,
+                        scratch, BMPREAD_SCRATCH_SIZE(128),
+                        (unsigned char *)data, sizeof(data), &wide));
+    fclose(fp);
+}
+
+static void test_BMPREAD_LINEAR(void)
+{
+    bmpread_t srgb;
+    bmpread_t linear;
+    bmpread_t fl;
+    read_context ctx;
+    int i;
+
+    memset(&ctx, 0, sizeof(ctx));
+    BuildLinearTable(&ctx);
+
+    assert(bmpread("../example/example-32bpp-a8r8g8b8.bmp", BMPREAD_ALPHA,
+                   &srgb));
+    assert(bmpread("../example/example-32bpp-a8r8g8b8.bmp",
+                   BMPREAD_ALPHA | BMPREAD_LINEAR, &linear));
+    assert(bmpread("../example/example-32bpp-a8r8g8b8.bmp",
+                   BMPREAD_ALPHA | BMPREAD_LINEAR | BMPREAD_FLOAT, &fl));
+
+    for(i = 0; i < srgb.width * srgb.height * 4; i++)
+    {
+        float value = ((const float *)(const void *)fl.data)[i];
+
+        if(i % 4 == 3)
+        {
+            /* Alpha is left alone. */
+            assert(linear.data[i] == srgb.data[i]);
+            assert(value * 255 > srgb.data[i] - 0.01f);
+            assert(value * 255 < srgb.data[i] + 0.01f);
+        }
+        else
+        {
+            assert(value == ctx.to_linear[srgb.data[i]]);
+            assert(linear.data[i] ==
+                   (uint8_t)(ctx.to_linear[srgb.data[i]] * 255 + 0.5f));
+        }
+    }
+
+    bmpread_free(&srgb);
+    bmpread_free(&linear);
+    bmpread_free(&fl);
+}
+
+static void test_Premultiply(void)
+{
+    uint32_t c;
+    uint32_t a;
+
+    for(c = 0; c < 256; c++)
+        for(a = 0; a < 256; a++)
+            assert(Premultiply(c, a, 8) == (2 * c * a + 255) / 510);
+
+    for(c = 0; c < 65536; c += 251)
+    {
+        assert(Premultiply(c, 65535, 16) == c);
+        assert(Premultiply(c, 0, 16) == 0);
+        for(a = 0; a < 65536; a += 257)
+            assert(Premultiply(c, a, 16) ==
+                   (uint32_t)(((double)c * a) / 65535 + 0.5));
+    }
+}
+
+static void test_BMPREAD_PREMULTIPLY(void)
+{
+    static const char * const alpha_bitmaps[] =
+    {
+        "../example/example-16bpp-a1r5g5b5.bmp",
+        "../example/example-32bpp-a8r8g8b8.bmp",
+        NULL
+    };
+    bmpread_t straight;
+    bmpread_t premultiplied;
+    bmpread_t wide;
+    bmpread_t other;
+    int i;
+    int p;
+    int c;
+
+    for(i = 0; alpha_bitmaps[i]; i++)
+    {
+        const uint16_t * p_wide;
+
+        assert(bmpread(alpha_bitmaps[i], BMPREAD_ALPHA, &straight));
+        assert(bmpread(alpha_bitmaps[i], BMPREAD_ALPHA | BMPREAD_PREMULTIPLY,
+                       &premultiplied));
+        assert(bmpread(alpha_bitmaps[i],
+                       BMPREAD_ALPHA | BMPREAD_PREMULTIPLY | BMPREAD_UINT16,
+                       &wide));
+        p_wide = (const uint16_t *)(const void *)wide.data;
+
+        for(p = 0; p < straight.width * straight.height; p++)
+        {
+            const uint8_t * p_straight = straight.data + p * 4;
+            const uint8_t * p_pre = premultiplied.data + p * 4;
+
+            for(c = 0; c < 3; c++)
+                assert(p_pre[c] ==
+                       Premultiply(p_straight[c], p_straight[3], 8));
+            assert(p_pre[3] == p_straight[3]);
+
+            /* Wide output multiplies at full precision. */
+            assert(p_wide[p * 4 + 3] / 257 == p_straight[3]);
+            for(c = 0; c < 3; c++)
+                assert(p_wide[p * 4 + c] <= p_wide[p * 4 + 3]);
+        }
+
+        bmpread_free(&straight);
+        bmpread_free(&premultiplied);
+        bmpread_free(&wide);
+    }
+
+    /* Nothing changes without alpha. */
+    assert(bmpread("../example/example-32bpp-a8r8g8b8.bmp", 0, &straight));
+    assert(bmpread("../example/example-32bpp-a8r8g8b8.bmp",
+                   BMPREAD_PREMULTIPLY, &other));
+    assert(!memcmp(straight.data, other.data,
+                   LineLength(&straight) * straight.height));
+    bmpread_free(&straight);
+    bmpread_free(&other);
+
+    for(i = 0; test_bitmaps[i]; i++)
+    {
+        read_context ctx;
+
+        if(strstr(test_bitmaps[i], "-a"))
+            continue;
+
+        assert(bmpread(test_bitmaps[i], BMPREAD_ALPHA, &straight));
+        assert(bmpread(test_bitmaps[i], BMPREAD_ALPHA | BMPREAD_PREMULTIPLY,
+                       &other));
+        assert(!memcmp(straight.data, other.data,
+                       LineLength(&straight) * straight.height));
+        bmpread_free(&straight);
+        bmpread_free(&other);
+
+        /* So they're decoded exactly as usual. */
+        memset(&ctx, 0, sizeof(ctx));
+        ctx.allocator = global_allocator;
+        assert((ctx.fp = fopen(test_bitmaps[i], "rb")));
+        assert(Prepare(&ctx, BMPREAD_ALPHA | BMPREAD_PREMULTIPLY));
+        assert(!ctx.premultiply);
+        FreeContext(&ctx, 0);
+    }
+}
+
+static void test_bmpread_ctx_read(void)
+{
+    bmpread_ctx_t * p_reuse;
+    const char * const * file;
+    unsigned char * last_data = NULL;
+
+    assert((p_reuse = bmpread_ctx_new()));
+
+    for(file = test_bitmaps; *file; file++)
+    {
+        bmpread_t whole;
+        bmpread_t reused;
+        int y;
+
+        assert(bmpread(*file, BMPREAD_SCALE_2 | BMPREAD_SCALE_AVERAGE,
+                       &whole));
+        assert(bmpread_ctx_read(p_reuse, *file,
+                                BMPREAD_SCALE_2 | BMPREAD_SCALE_AVERAGE,
+                                &reused));
+        assert(reused.width == whole.width);
+        assert(reused.height == whole.height);
+        assert(reused.flags == whole.flags);
+
+        for(y = 0; y < whole.height; y++)
+        {
+            assert(!memcmp(reused.data + y * LineLength(&reused),
+                           whole.data + y * LineLength(&whole),
+                           PixelBytes(&whole)));
+        }
+
+        /* All these bitmaps decode to the same size, so after the first, the
+         * output buffer never needs to grow.
+         */
+        if(last_data)
+            assert(reused.data == last_data);
+        last_data = reused.data;
+
+        bmpread_free(&whole);
+    }
+
+    {
+        bmpread_t bmp;
+        assert(!bmpread_ctx_read(p_reuse, test_data, 0, &bmp));
+        assert(!bmpread_ctx_read(NULL, test_bitmaps[0], 0, &bmp));
+    }
+
+    bmpread_ctx_free(p_reuse);
+}
+
+/* Counts what test_allocator hands out, so we can check it's all freed. */
+static long allocations = 0;
+
+static void * CountingAllocate(size_t size, void * user)
+{
+    (*(long *)user)++;
+    return malloc(size);
+}
+
+static void CountingDeallocate(void * ptr, void * user)
+{
+    assert(ptr);
+    (*(long *)user)--;
+    free(ptr);
+}
+
+/* Writes little-endian integers of the given size to a file. */
+static void WriteLittle(FILE * fp, unsigned long value, int bytes)
+{
+    for(; bytes > 0; bytes--, value >>= 8)
+        assert(fputc((int)(value & 0xff), fp) != EOF);
+}
+
+/* Writes a 32-bit bitmap with 10-bit color masks, filled with a ramp of every
+ * 10-bit value.
+ */
+static void Write10BitBitmap(const char * name)
+{
+    enum { WIDTH = 64, HEIGHT = 16 };
+    FILE * fp;
+    unsigned long v;
+
+    assert((fp = fopen(name, "wb")));
+    WriteLittle(fp, 'B' | ('M' << 8), 2);
+    WriteLittle(fp, 70 + WIDTH * HEIGHT * 4, 4);
+    WriteLittle(fp, 0, 4);
+    WriteLittle(fp, 70, 4);
+    WriteLittle(fp, 56, 4);
+    WriteLittle(fp, WIDTH, 4);
+    WriteLittle(fp, HEIGHT, 4);
+    WriteLittle(fp, 1, 2);
+    WriteLittle(fp, 32, 2);
+    WriteLittle(fp, 3, 4);
+    WriteLittle(fp, WIDTH * HEIGHT * 4, 4);
+    WriteLittle(fp, 2835, 4);
+    WriteLittle(fp, 2835, 4);
+    WriteLittle(fp, 0, 4);
+    WriteLittle(fp, 0, 4);
+    WriteLittle(fp, 0x3ff00000, 4);
+    WriteLittle(fp, 0x000ffc00, 4);
+    WriteLittle(fp, 0x000003ff, 4);
+    WriteLittle(fp, 0, 4);
+
+    for(v = 0; v < WIDTH * HEIGHT; v++)
+        WriteLittle(fp, (v << 20) | ((1023 - v) << 10) | (v * 7 % 1024), 4);
+
+    assert(!fclose(fp));
+}
+
+static void test_bmpread_ctx_set_lut(void)
+{
+    static const unsigned int flags[] =
+    {
+        BMPREAD_ALPHA,
+        BMPREAD_BGR | BMPREAD_ALPHA | BMPREAD_ALPHA_FIRST,
+        BMPREAD_SCALE_2
+    };
+    const char * const wide_name = "./wide.bmp";
+    unsigned char identity[256];
+    unsigned char invert[256];
+    unsigned char zero[256];
+    bmpread_ctx_t * p_reuse;
+    bmpread_t plain;
+    bmpread_t looked_up;
+    size_t f;
+    int i;
+
+    for(i = 0; i < 256; i++)
+    {
+        identity[i] = (unsigned char)i;
+        invert[i]   = (unsigned char)(255 - i);
+        zero[i]     = 0;
+    }
+
+    assert((p_reuse = bmpread_ctx_new()));
+
+    for(i = 0; test_bitmaps[i]; i++)
+    {
+        for(f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            size_t channels = ((flags[f] & BMPREAD_ALPHA) ? 4 : 3);
+            size_t first    = ((flags[f] & BMPREAD_ALPHA_FIRST) ? 1 : 0);
+            int x;
+            int y;
+
+            assert(bmpread(test_bitmaps[i], flags[f], &plain));
+
+            /* Every color is inverted, even files read without decoding. */
+            bmpread_ctx_set_lut(p_reuse, invert, NULL, NULL);
+            assert(bmpread_ctx_read(p_reuse, test_bitmaps[i], flags[f],
+                                    &looked_up));
+            for(y = 0; y < plain.height; y++)
+            {
+                const uint8_t * p_plain = plain.data + y * LineLength(&plain);
+                const uint8_t * p_lut = looked_up.data +
+                                        y * LineLength(&looked_up);
+
+                for(x = 0; x < plain.width; x++)
+                {
+                    size_t c;
+                    for(c = 0; c < channels; c++)
+                    {
+                        size_t at = x * channels + c;
+                        if(c == (first ? 0 : 3))
+                            assert(p_lut[at] == p_plain[at]);
+                        else
+                            assert(p_lut[at] == 255 - p_plain[at]);
+                    }
+                }
+            }
+
+            /* Each color can have its own table. */
+            bmpread_ctx_set_lut(p_reuse, zero, identity, invert);
+            assert(bmpread_ctx_read(p_reuse, test_bitmaps[i], flags[f],
+                                    &looked_up));
+            for(x = 0; x < plain.width; x++)
+            {
+                const uint8_t * p_plain = plain.data + x * channels + first;
+                const uint8_t * p_lut = looked_up.data + x * channels + first;
+                size_t red  = ((flags[f] & BMPREAD_BGR) ? 2 : 0);
+                size_t blue = 2 - red;
+
+                assert(p_lut[red] == 0);
+                assert(p_lut[1] == p_plain[1]);
+                assert(p_lut[blue] == 255 - p_plain[blue]);
+            }
+
+            /* And they can be taken away again. */
+            bmpread_ctx_set_lut(p_reuse, NULL, NULL, NULL);
+            assert(bmpread_ctx_read(p_reuse, test_bitmaps[i], flags[f],
+                                    &looked_up));
+            assert(!memcmp(looked_up.data, plain.data,
+                           LineLength(&plain) * plain.height));
+
+            bmpread_free(&plain);
+        }
+    }
+
+    /* Indexed files have the tables applied to their palette. */
+    bmpread_ctx_set_lut(p_reuse, invert, NULL, NULL);
+    assert(bmpread("../example/example-8bpp.bmp", BMPREAD_INDEXED, &plain));
+    assert(bmpread_ctx_read(p_reuse, "../example/example-8bpp.bmp",
+                            BMPREAD_INDEXED, &looked_up));
+    assert(!memcmp(looked_up.data, plain.data,
+                   LineLength(&plain) * plain.height));
+    for(i = 0; i < plain.colors * 3; i++)
+        assert(looked_up.palette[i] == 255 - plain.palette[i]);
+    bmpread_free(&plain);
+
+    /* Wide components are looked up by their top bits. */
+    assert(bmpread("../example/example-24bpp.bmp", 0, &plain));
+    assert(bmpread_ctx_read(p_reuse, "../example/example-24bpp.bmp",
+                            BMPREAD_UINT16, &looked_up));
+    for(i = 0; i < plain.width * plain.height * 3; i++)
+        assert(((const uint16_t *)(const void *)looked_up.data)[i] ==
+               (255 - plain.data[i]) * 257);
+    bmpread_free(&plain);
+
+    /* Components between table entries are interpolated, so an identity
+     * table leaves them exact.
+     */
+    bmpread_ctx_set_lut(p_reuse, identity, identity, identity);
+    Write10BitBitmap(wide_name);
+    for(f = 0; f < 2; f++)
+    {
+        unsigned int wide = (f ? BMPREAD_FLOAT : BMPREAD_UINT16);
+
+        assert(bmpread(wide_name, wide, &plain));
+        assert(bmpread_ctx_read(p_reuse, wide_name, wide, &looked_up));
+        assert(!memcmp(looked_up.data, plain.data,
+                       LineLength(&plain) * plain.height));
+        bmpread_free(&plain);
+    }
+    assert(bmpread(wide_name, BMPREAD_UINT16, &plain));
+    for(i = 0; i < plain.width * plain.height * 3; i++)
+        if(((const uint16_t *)(const void *)plain.data)[i] % 257)
+            break;
+    assert(i < plain.width * plain.height * 3);
+    bmpread_free(&plain);
+    remove(wide_name);
+
+    bmpread_ctx_free(p_reuse);
+}
+
+/* Writes a 24-bit bitmap holding the pixels bmpread() loaded with
+ * BMPREAD_BGR and no other flags, whose lines are already laid out the way
+ * the file stores them.
+ */
+static void WriteBgrBitmap(const char * name, const bmpread_t * p_bmp)
+{
+    unsigned long data_len = (unsigned long)LineLength(p_bmp) * p_bmp->height;
+    FILE * fp;
+
+    assert((fp = fopen(name, "wb")));
+    WriteLittle(fp, 'B' | ('M' << 8), 2);
+    WriteLittle(fp, 54 + data_len, 4);
+    WriteLittle(fp, 0, 4);
+    WriteLittle(fp, 54, 4);
+    WriteLittle(fp, 40, 4);
+    WriteLittle(fp, (unsigned long)p_bmp->width, 4);
+    WriteLittle(fp, (unsigned long)p_bmp->height, 4);
+    WriteLittle(fp, 1, 2);
+    WriteLittle(fp, 24, 2);
+    WriteLittle(fp, 0, 4);
+    WriteLittle(fp, data_len, 4);
+    WriteLittle(fp, 2835, 4);
+    WriteLittle(fp, 2835, 4);
+    WriteLittle(fp, 0, 4);
+    WriteLittle(fp, 0, 4);
+    assert(fwrite(p_bmp->data, 1, data_len, fp) == data_len);
+    assert(!fclose(fp));
+}
+
+static void test_bmpread_ctx_set_color_key(void)
+{
+    const char * const copy_name = "./copy.bmp";
+    unsigned char invert[256];
+    bmpread_ctx_t * p_reuse;
+    bmpread_ctx_t * p_copy;
+    bmpread_t plain;
+    bmpread_t keyed;
+    long key;
+    int keys;
+    int i;
+
+    assert((p_reuse = bmpread_ctx_new()));
+
+    for(i = 0; test_bitmaps[i]; i++)
+    {
+        int p;
+
+        keys = 0;
+
+        /* Key out whatever color the first pixel is. */
+        assert(bmpread(test_bitmaps[i], BMPREAD_ALPHA, &plain));
+        key = ((long)plain.data[0] << 16) | (plain.data[1] << 8) |
+              plain.data[2];
+        bmpread_ctx_set_color_key(p_reuse, key);
+
+        assert(bmpread_ctx_read(p_reuse, test_bitmaps[i], BMPREAD_ALPHA,
+                                &keyed));
+        for(p = 0; p < plain.width * plain.height; p++)
+        {
+            const uint8_t * p_plain = plain.data + p * 4;
+            const uint8_t * p_keyed = keyed.data + p * 4;
+            int is_key = (((long)p_plain[0] << 16) | (p_plain[1] << 8) |
+                          p_plain[2]) == key;
+
+            assert(!memcmp(p_keyed, p_plain, 3));
+            assert(p_keyed[3] == (is_key ? 0 : 255));
+            keys += is_key;
+        }
+        assert(keys > 0);
+
+        /* Premultiplying blacks out the key. */
+        assert(bmpread_ctx_read(p_reuse, test_bitmaps[i],
+                                BMPREAD_ALPHA | BMPREAD_PREMULTIPLY, &keyed));
+        for(p = 0; p < plain.width * plain.height; p++)
+        {
+            const uint8_t * p_plain = plain.data + p * 4;
+            const uint8_t * p_keyed = keyed.data + p * 4;
+
+            if(p_keyed[3])
+                assert(!memcmp(p_keyed, p_plain, 3));
+            else
+                assert(!p_keyed[0] && !p_keyed[1] && !p_keyed[2]);
+        }
+
+        /* Nothing happens without alpha. */
+        bmpread_free(&plain);
+        assert(bmpread(test_bitmaps[i], 0, &plain));
+        assert(bmpread_ctx_read(p_reuse, test_bitmaps[i], 0, &keyed));
+        assert(!memcmp(keyed.data, plain.data,
+                       LineLength(&plain) * plain.height));
+        bmpread_free(&plain);
+
+        bmpread_ctx_set_color_key(p_reuse, -1);
+        assert(bmpread(test_bitmaps[i], BMPREAD_ALPHA_ONLY, &plain));
+        assert(bmpread_ctx_read(p_reuse, test_bitmaps[i], BMPREAD_ALPHA_ONLY,
+                                &keyed));
+        assert(!memcmp(keyed.data, plain.data,
+                       LineLength(&plain) * plain.height));
+        bmpread_free(&plain);
+    }
+
+    /* Indexed files key their palette. */
+    assert(bmpread("../example/example-4bpp.bmp", BMPREAD_INDEXED, &plain));
+    bmpread_ctx_set_color_key(p_reuse, ((long)plain.palette[9] << 16) |
+                                       (plain.palette[10] << 8) |
+                                       plain.palette[11]);
+    assert(bmpread_ctx_read(p_reuse, "../example/example-4bpp.bmp",
+                            BMPREAD_INDEXED | BMPREAD_ALPHA, &keyed));
+    assert(!memcmp(keyed.data, plain.data, LineLength(&plain) * plain.height));
+    for(i = 0; i < plain.colors; i++)
+    {
+        int is_key = !memcmp(plain.palette + i * 3, plain.palette + 9, 3);
+
+        assert(!memcmp(keyed.palette + i * 4, plain.palette + i * 3, 3));
+        assert(keyed.palette[i * 4 + 3] == (is_key ? 0 : 255));
+    }
+    bmpread_free(&plain);
+
+    /* Palette files key, look up and premultiply their palette instead of
+     * each pixel, which has to come out the same as a copy of the image with
+     * no palette.  The key's entry turns black only after the table.
+     */
+    for(i = 0; i < 256; i++)
+        invert[i] = (unsigned char)(255 - i);
+
+    assert(bmpread("../example/example-8bpp.bmp", BMPREAD_BGR, &plain));
+    WriteBgrBitmap(copy_name, &plain);
+    key = ((long)plain.data[2] << 16) | (plain.data[1] << 8) | plain.data[0];
+    bmpread_free(&plain);
+
+    assert((p_copy = bmpread_ctx_new()));
+    bmpread_ctx_set_color_key(p_reuse, key);
+    bmpread_ctx_set_color_key(p_copy, key);
+    bmpread_ctx_set_lut(p_reuse, invert, invert, invert);
+    bmpread_ctx_set_lut(p_copy, invert, invert, invert);
+    assert(bmpread_ctx_read(p_reuse, "../example/example-8bpp.bmp",
+                            BMPREAD_ALPHA | BMPREAD_PREMULTIPLY, &plain));
+    assert(bmpread_ctx_read(p_copy, copy_name,
+                            BMPREAD_ALPHA | BMPREAD_PREMULTIPLY, &keyed));
+    assert(keyed.width == plain.width && keyed.height == plain.height);
+    assert(!memcmp(keyed.data, plain.data, LineLength(&plain) * plain.height));
+    for(i = keys = 0; i < plain.width * plain.height; i++)
+    {
+        if(!plain.data[i * 4 + 3])
+        {
+            assert(!plain.data[i * 4] && !plain.data[i * 4 + 1] &&
+                   !plain.data[i * 4 + 2]);
+            keys++;
+        }
+    }
+    assert(keys > 0);
+    bmpread_ctx_free(p_copy);
+    remove(copy_name);
+
+    bmpread_ctx_free(p_reuse);
+}
+
+static void test_plain_output(void)
+{
+    /* Plain 8-bit output gets its own decoders.  16-bit output of the same
+     * files goes through the general ones, and is each component times 257,
+     * so the two can be compared.  16-bit files are left out, since their
+     * narrower channels widen to 16 bits on their own.
+     */
+    static const unsigned int flags[] =
+    {
+        0,
+        BMPREAD_ALPHA,
+        BMPREAD_BGR | BMPREAD_ALPHA | BMPREAD_ALPHA_FIRST,
+        BMPREAD_BGR | BMPREAD_TOP_DOWN | BMPREAD_BYTE_ALIGN | BMPREAD_ANY_SIZE,
+        BMPREAD_ALPHA | BMPREAD_MIRROR | BMPREAD_ROTATE_90,
+        BMPREAD_SCALE_2
+    };
+    bmpread_t plain;
+    bmpread_t wide;
+    size_t f;
+    int i;
+
+    for(i = 0; test_bitmaps[i]; i++)
+    {
+        if(strstr(test_bitmaps[i], "16bpp"))
+            continue;
+
+        for(f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            int y;
+            size_t x;
+
+            assert(bmpread(test_bitmaps[i], flags[f], &plain));
+            assert(bmpread(test_bitmaps[i], flags[f] | BMPREAD_UINT16, &wide));
+            assert(plain.width == wide.width);
+            assert(plain.height == wide.height);
+            for(y = 0; y < plain.height; y++)
+            {
+                const uint8_t * p_plain = plain.data + y * LineLength(&plain);
+                const uint16_t * p_wide = (const uint16_t *)(const void *)
+                                          (wide.data + y * LineLength(&wide));
+
+                for(x = 0; x < PixelBytes(&plain); x++)
+                    assert(p_wide[x] == p_plain[x] * 257);
+            }
+            bmpread_free(&wide);
+            bmpread_free(&plain);
+        }
+    }
+}
+
+static void test_bmpread_set_allocator(void)
+{
+    bmpread_allocator_t allocator;
+    bmpread_ctx_t * p_reuse;
+    bmpread_stream_t * p_stream;
+    bmpread_tiles_t * p_tiles;
+    bmpread_t bmp;
+    long ctx_allocations = 0;
+
+    allocator.allocate   = CountingAllocate;
+    allocator.deallocate = CountingDeallocate;
+    allocator.user       = &allocations;
+    bmpread_set_allocator(&allocator);
+
+    assert(bmpread(test_bitmaps[0], 0, &bmp));
+    assert(allocations == 1);
+    bmpread_free(&bmp);
+    assert(allocations == 0);
+
+    assert(!bmpread(test_data, 0, &bmp));
+    assert(allocations == 0);
+
+    assert((p_stream = bmpread_open(test_bitmaps[0], 0, &bmp)));
+    assert(bmpread_next_row(p_stream));
+    bmpread_close(p_stream);
+    assert(allocations == 0);
+
+    assert((p_tiles = bmpread_tiles_open(test_bitmaps[0], 0, 16, 1 << 16,
+                                         &bmp)));
+    assert(bmpread_tile(p_tiles, 1, 1, &bmp));
+    assert(bmpread_tile(p_tiles, 2, 1, &bmp));
+    bmpread_tiles_close(p_tiles);
+    assert(allocations == 0);
+
+    /* A context's own allocator takes precedence. */
+    allocator.user = &ctx_allocations;
+    assert((p_reuse = bmpread_ctx_new_with_allocator(&allocator)));
+    assert(bmpread_ctx_read(p_reuse, test_bitmaps[0], 0, &bmp));
+    assert(allocations == 0);
+    assert(ctx_allocations > 0);
+    bmpread_ctx_free(p_reuse);
+    assert(ctx_allocations == 0);
+
+    bmpread_set_allocator(NULL);
+    assert(bmpread(test_bitmaps[0], 0, &bmp));
+    bmpread_free(&bmp);
+    assert(allocations == 0);
+}
+
+static void test_bmpread_into(void)
+{
+    static max_align scratch[SCRATCH_ITEMS];
+    static unsigned char data[128 * 128 * 4];
+    bmpread_allocator_t allocator;
+    bmpread_t bmp;
+    bmpread_t into;
+    FILE * fp;
+    int i;
+
+    allocator.allocate   = CountingAllocate;
+    allocator.deallocate = CountingDeallocate;
+    allocator.user       = &allocations;
+
+    for(i = 0; test_bitmaps[i]; i++)
+    {
+        unsigned int flags = ((i & 1) ?
+                              BMPREAD_ALPHA | BMPREAD_TOP_DOWN :
+                              BMPREAD_SCALE_2 | BMPREAD_SCALE_AVERAGE);
+
+        assert(bmpread(test_bitmaps[i], flags, &bmp));
+        assert((fp = fopen(test_bitmaps[i], "rb")));
+
+        bmpread_set_allocator(&allocator);
+        assert(bmpread_into(fp, flags, scratch, sizeof(scratch),
+                            data, sizeof(data), &into));
+        /* Reading again seeks back to the start. */
+        assert(bmpread_into(fp, flags, scratch, sizeof(scratch),
+                            data, sizeof(data), &into));
+        bmpread_set_allocator(NULL);
+        assert(allocations == 0);
+
+        assert(into.data == data);
+        assert(into.width == bmp.width);
+        assert(into.height == bmp.height);
+        assert(!memcmp(into.data, bmp.data, LineLength(&bmp) * bmp.height));
+
+        /* Too little of either kind of memory fails cleanly. */
+        assert(!bmpread_into(fp, BMPREAD_SCALE_2 | BMPREAD_SCALE_AVERAGE,
+                             scratch, 16, data, sizeof(data), &into));
+        assert(!bmpread_into(fp, flags, scratch, sizeof(scratch),
+                             data, LineLength(&bmp) * bmp.height - 1, &into));
+
+        fclose(fp);
+        bmpread_free(&bmp);
+    }
+}
+
+static void test_BMPREAD_SCRATCH_SIZE(void)
+{
+    /* Between them, these make every buffer as big as it gets for the
+     * example files, which are 128 pixels wide.
+     */
+    static const unsigned int flags[] =
+    {
+        BMPREAD_FLOAT | BMPREAD_ALPHA | BMPREAD_ROTATE_90,
+        BMPREAD_FLOAT | BMPREAD_ALPHA | BMPREAD_SCALE_2 |
+            BMPREAD_SCALE_AVERAGE | BMPREAD_CHECKSUM | BMPREAD_STATS,
+        BMPREAD_FLOAT | BMPREAD_ALPHA | BMPREAD_INDEXED | BMPREAD_STATS
+    };
+    static max_align scratch[SCRATCH_ITEMS];
+    static float data[128 * 128 * 4];
+    bmpread_ctx_t * p_reuse;
+    bmpread_t bmp;
+    FILE * fp;
+    size_t f;
+    int b;
+    int i;
+
+    assert(sizeof(max_align) <= BMPREAD_SCRATCH_ALIGN);
+    assert((p_reuse = bmpread_ctx_new()));
+
+    for(i = 0; test_bitmaps[i]; i++)
+    {
+        for(f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            /* Only the first three files have indices. */
+            if((flags[f] & BMPREAD_INDEXED) && i > 2)
+                continue;
+
+            assert(bmpread_ctx_read(p_reuse, test_bitmaps[i], flags[f],
+                                    &bmp));
+
+            assert((fp = fopen(test_bitmaps[i], "rb")));
+            assert(bmpread_into(fp, flags[f], scratch,
+                                BMPREAD_SCRATCH_SIZE(128),
+                                (unsigned char *)data, sizeof(data), &bmp));
+            fclose(fp);
+        }
+    }
+
+    /* The context keeps the biggest of each buffer it's been asked for. */
+    for(b = 0; b < BUFFER_COUNT; b++)
+    {
+        size_t size = p_reuse->buffers[b].size;
+
+        switch(b)
+        {
+        case BUFFER_PALETTE:
+            assert(size == BMPREAD_SCRATCH_PALETTE);
+            break;
+        case BUFFER_PALETTE_OUT:
+            assert(size == BMPREAD_SCRATCH_PALETTE_OUT);
+            break;
+        case BUFFER_CRC:
+            /* The biggest only comes with billions of lines. */
+            assert(size > 0 && size <= BMPREAD_SCRATCH_CRC);
+            break;
+        case BUFFER_STATS:
+            assert(size == BMPREAD_SCRATCH_STATS);
+            break;
+        case BUFFER_FILE_DATA:
+            assert(size == BMPREAD_SCRATCH_FILE_LINE(128));
+            break;
+        case BUFFER_LINE:
+            assert(size == BMPREAD_SCRATCH_LINE(128));
+            break;
+        case BUFFER_SUMS:
+            assert(size == BMPREAD_SCRATCH_SUMS(128));
+            break;
+        case BUFFER_BAND:
+            assert(size == BMPREAD_SCRATCH_BAND(128));
+            break;
+        case BUFFER_DATA_OUT:
+            /* bmpread_into() puts this in the caller's data instead. */
+            break;
+        default:
+            /* The rest are only for bmpread_resized(). */
+            assert(size == 0);
+            break;
+        }
+    }
+
+    bmpread_ctx_free(p_reuse);
+}
+
+static void test_bmpread_open(void)
+{
+    static const unsigned int flags[] =
+    {
+        0, BMPREAD_TOP_DOWN, BMPREAD_ALPHA | BMPREAD_BYTE_ALIGN
+    };
+
+    const char * const * file;
+    size_t i;
+
+    for(file = test_bitmaps; *file; file++)
+    {
+        for(i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+        {
+            bmpread_t whole;
+            bmpread_t rows;
+            bmpread_stream_t * p_stream;
+            int y;
+
+            assert(bmpread(*file, flags[i], &whole));
+            assert((p_stream = bmpread_open(*file, flags[i], &rows)));
+            assert(rows.width == whole.width);
+            assert(rows.height == whole.height);
+            assert(rows.flags == whole.flags);
+            assert(!rows.data);
+
+            for(y = 0; y < whole.height; y++)
+            {
+                const unsigned char * row = bmpread_next_row(p_stream);
+                assert(row);
+                assert(!memcmp(row, whole.data + y * LineLength(&whole),
+                               PixelBytes(&whole)));
+            }
+            assert(!bmpread_next_row(p_stream));
+
+            bmpread_close(p_stream);
+            bmpread_free(&whole);
+        }
+    }
+
+    {
+        bmpread_t bmp;
+        assert(!bmpread_open(test_data, 0, &bmp));
+        assert(!bmpread_open(NULL, 0, &bmp));
+    }
+}
+
+static void test_bmpread_region(void)
+{
+    static const unsigned int flags[] =
+    {
+        BMPREAD_ANY_SIZE, BMPREAD_ANY_SIZE | BMPREAD_TOP_DOWN,
+        BMPREAD_ANY_SIZE | BMPREAD_ALPHA | BMPREAD_BYTE_ALIGN
+    };
+
+    /* Odd offsets and sizes, to start and end partway through bytes. */
+    static const int regions[][4] =
+    {
+        {0, 0, 128, 128}, {3, 5, 7, 9}, {0, 127, 128, 1}, {121, 1, 7, 126}
+    };
+
+    const char * const * file;
+    size_t i;
+    size_t j;
+
+    for(file = test_bitmaps; *file; file++)
+    {
+        for(i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+        {
+            bmpread_t whole;
+            assert(bmpread(*file, flags[i], &whole));
+
+            for(j = 0; j < sizeof(regions) / sizeof(regions[0]); j++)
+            {
+                const int * r = regions[j];
+                size_t pixel_span = PixelBytes(&whole) / whole.width;
+                bmpread_t region;
+                int y;
+
+                assert(bmpread_region(*file, flags[i], r[0], r[1], r[2], r[3],
+                                      &region));
+                assert(region.width == r[2]);
+                assert(region.height == r[3]);
+
+                for(y = 0; y < region.height; y++)
+                {
+                    assert(!memcmp(region.data + y * LineLength(&region),
+                                   whole.data + (r[1] + y) * LineLength(&whole)
+                                              + r[0] * pixel_span,
+                                   PixelBytes(&region)));
+                }
+
+                bmpread_free(&region);
+            }
+
+            bmpread_free(&whole);
+        }
+    }
+
+    {
+        bmpread_t bmp;
+        const char * file = test_bitmaps[0];
+
+        assert(!bmpread_region(file, BMPREAD_ANY_SIZE, 1, 0, 128, 1, &bmp));
+        assert(!bmpread_region(file, BMPREAD_ANY_SIZE, 0, 1, 1, 128, &bmp));
+        assert(!bmpread_region(file, BMPREAD_ANY_SIZE, -1, 0, 1, 1, &bmp));
+        assert(!bmpread_region(file, BMPREAD_ANY_SIZE, 0, 0, 0, 1, &bmp));
+        assert(!bmpread_region(file, 0, 0, 0, 3, 4, &bmp));
+        assert(bmpread_region(file, 0, 4, 4, 4, 8, &bmp));
+        bmpread_free(&bmp);
+    }
+}
+
+/* Weight of input pixel i in output pixel o, resizing src pixels to dst,
+ * worked out the slow way.
+ */
+static double ResizeWeight(int src, int dst, int o, int i)
+{
+    double scale = (double)src / dst;
+
+    if(src > dst)
+    {
+        double left  = ((i > o * scale) ? i : o * scale);
+        double right = ((i + 1 < (o + 1) * scale) ? i + 1 : (o + 1) * scale);
+        return ((right > left) ? (right - left) / scale : 0);
+    }
+    else
+    {
+        double center = (o + 0.5) * scale - 0.5;
+
+        if(center < 0)       center = 0;
+        if(center > src - 1) center = src - 1;
+
+        if(i == (int)center)
+            return 1 - (center - i);
+        if(i == (int)center + 1)
+            return center - (i - 1);
+        return 0;
+    }
+}
+
+static void test_bmpread_resized(void)
+{
+    static const unsigned int flags[] =
+    {
+        0,
+        BMPREAD_TOP_DOWN | BMPREAD_ALPHA | BMPREAD_BYTE_ALIGN,
+        BMPREAD_PLANAR | BMPREAD_GRAY | BMPREAD_ALPHA,
+        BMPREAD_UINT16 | BMPREAD_MIRROR | BMPREAD_ROTATE_180,
+        BMPREAD_FLOAT | BMPREAD_SCALE_2 | BMPREAD_SCALE_AVERAGE
+    };
+
+    const char * const * file;
+    size_t f;
+
+    for(file = test_bitmaps; *file; file++)
+    {
+        for(f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            bmpread_t plain;
+            bmpread_t resized;
+            bmpread_t other;
+            int y;
+
+            /* The same size comes out exactly the same. */
+            assert(bmpread(*file, flags[f], &plain));
+            assert(bmpread_resized(*file, flags[f], plain.width, plain.height,
+                                   &resized));
+            assert(resized.width == plain.width);
+            assert(resized.height == plain.height);
+            assert(!memcmp(resized.data, plain.data,
+                           LineLength(&plain) * plain.height *
+                           ((flags[f] & BMPREAD_PLANAR) ? 2 : 1)));
+            bmpread_free(&resized);
+            bmpread_free(&plain);
+
+            /* Neither the order lines come out in, nor planes, changes any
+             * pixel.
+             */
+            assert(bmpread_resized(*file, flags[f] | BMPREAD_ANY_SIZE, 37, 100,
+                                   &resized));
+            assert(resized.width == 37);
+            assert(resized.height == 100);
+            assert(bmpread_resized(*file,
+                                   (flags[f] | BMPREAD_ANY_SIZE) ^
+                                   BMPREAD_TOP_DOWN,
+                                   37, 100, &other));
+            for(y = 0; y < 100; y++)
+                assert(!memcmp(resized.data + y * LineLength(&resized),
+                               other.data + (99 - y) * LineLength(&other),
+                               PixelBytes(&resized)));
+            bmpread_free(&other);
+
+            if(!(flags[f] & BMPREAD_PLANAR))
+            {
+                size_t channels = PixelBytes(&resized) / 37 /
+                                  ComponentBytes(&resized);
+                size_t plane_len;
+                size_t c;
+                int x;
+
+                assert(bmpread_resized(*file, flags[f] | BMPREAD_ANY_SIZE |
+                                              BMPREAD_PLANAR,
+                                       37, 100, &other));
+                plane_len = LineLength(&other) * 100;
+                for(y = 0; y < 100; y++)
+                {
+                    for(x = 0; x < 37; x++)
+                    {
+                        for(c = 0; c < channels; c++)
+                            assert(!memcmp(resized.data +
+                                           y * LineLength(&resized) +
+                                           (x * channels + c) *
+                                           ComponentBytes(&resized),
+                                           other.data + c * plane_len +
+                                           y * LineLength(&other) +
+                                           x * ComponentBytes(&other),
+                                           ComponentBytes(&other)));
+                    }
+                }
+                bmpread_free(&other);
+            }
+            bmpread_free(&resized);
+        }
+    }
+
+    /* Check the filters against the formulas, shrinking across and growing
+     * down.
+     */
+    {
+        bmpread_t plain;
+        bmpread_t resized;
+        int x;
+        int y;
+
+        assert(bmpread(test_bitmaps[6], BMPREAD_FLOAT | BMPREAD_TOP_DOWN,
+                       &plain));
+        assert(bmpread_resized(test_bitmaps[6],
+                               BMPREAD_FLOAT | BMPREAD_TOP_DOWN |
+                               BMPREAD_ANY_SIZE,
+                               48, 200, &resized));
+
+        for(y = 0; y < 200; y++)
+        {
+            for(x = 0; x < 48; x++)
+            {
+                int c;
+                for(c = 0; c < 3; c++)
+                {
+                    double expected = 0;
+                    int i;
+                    int j;
+
+                    for(j = 0; j < 128; j++)
+                    {
+                        double wy = ResizeWeight(128, 200, y, j);
+                        if(!wy)
+                            continue;
+                        for(i = 0; i < 128; i++)
+                            expected += wy * ResizeWeight(128, 48, x, i) *
+                                ((const float *)(const void *)
+                                 plain.data)[(j * 128 + i) * 3 + c];
+                    }
+
+                    expected -= ((const float *)(const void *)
+                                 resized.data)[(y * 48 + x) * 3 + c];
+                    assert(expected < 0.0001 && expected > -0.0001);
+                }
+            }
+        }
+
+        bmpread_free(&resized);
+        bmpread_free(&plain);
+    }
+
+    /* Halving matches averaging 2x2 blocks. */
+    {
+        bmpread_t averaged;
+        bmpread_t resized;
+        size_t i;
+
+        assert(bmpread(test_bitmaps[7], BMPREAD_ALPHA | BMPREAD_SCALE_2 |
+                                        BMPREAD_SCALE_AVERAGE,
+                       &averaged));
+        assert(bmpread_resized(test_bitmaps[7], BMPREAD_ALPHA, 64, 64,
+                               &resized));
+        for(i = 0; i < LineLength(&resized) * 64; i++)
+            assert(resized.data[i] - averaged.data[i] <= 1 &&
+                   averaged.data[i] - resized.data[i] <= 1);
+        bmpread_free(&resized);
+        bmpread_free(&averaged);
+    }
+
+    {
+        bmpread_t bmp;
+        const char * file = test_bitmaps[6];
+
+        assert(!bmpread_resized(file, 0, 0, 64, &bmp));
+        assert(!bmpread_resized(file, 0, 64, -1, &bmp));
+        assert(!bmpread_resized(file, 0, 48, 64, &bmp));
+        assert(!bmpread_resized(file, BMPREAD_ROTATE_90, 64, 64, &bmp));
+        assert(!bmpread_resized(test_bitmaps[2], BMPREAD_INDEXED, 64, 64,
+                                &bmp));
+        assert(bmpread_resized(file, 0, 1, 1, &bmp));
+        bmpread_free(&bmp);
+        assert(bmpread_resized(file, 0, 1024, 1, &bmp));
+        bmpread_free(&bmp);
+    }
+}
+
+/* Writes a 24-bit bitmap of the given size, filled with a pattern that
+ * depends on seed.
+ */
+static void WriteBitmap(const char * name, int width, int height, int seed)
+{
+    unsigned long line_len = (unsigned long)(width * 3 + 3) / 4 * 4;
+    FILE * fp;
+    int x;
+    int y;
+
+    assert((fp = fopen(name, "wb")));
+    WriteLittle(fp, 'B' | ('M' << 8), 2);
+    WriteLittle(fp, 54 + line_len * height, 4);
+    WriteLittle(fp, 0, 4);
+    WriteLittle(fp, 54, 4);
+    WriteLittle(fp, 40, 4);
+    WriteLittle(fp, (unsigned long)width, 4);
+    WriteLittle(fp, (unsigned long)height, 4);
+    WriteLittle(fp, 1, 2);
+    WriteLittle(fp, 24, 2);
+    WriteLittle(fp, 0, 4);
+    WriteLittle(fp, line_len * height, 4);
+    WriteLittle(fp, 2835, 4);
+    WriteLittle(fp, 2835, 4);
+    WriteLittle(fp, 0, 4);
+    WriteLittle(fp, 0, 4);
+
+    for(y = 0; y < height; y++)
+    {
+        for(x = 0; x < width; x++)
+        {
+            WriteLittle(fp, (unsigned long)(x * 7 + seed) & 0xff, 1);
+            WriteLittle(fp, (unsigned long)(y * 5 + seed * 3) & 0xff, 1);
+            WriteLittle(fp, (unsigned long)(x + y + seed * 11) & 0xff, 1);
+        }
+        WriteLittle(fp, 0, (int)(line_len - width * 3));
+    }
+
+    assert(!fclose(fp));
+}
+
+static void test_bmpread_atlas(void)
+{
+    static const int sizes[][2] =
+    {
+        {5, 7}, {16, 16}, {1, 1}, {31, 2}, {9, 20}, {16, 3}, {12, 12}, {2, 9}
+    };
+    static const unsigned int flags[] =
+    {
+        BMPREAD_ANY_SIZE,
+        BMPREAD_TOP_DOWN | BMPREAD_ALPHA | BMPREAD_BYTE_ALIGN,
+        BMPREAD_PLANAR | BMPREAD_UINT16 | BMPREAD_GRAY,
+        BMPREAD_ROTATE_90 | BMPREAD_MIRROR | BMPREAD_PLANAR | BMPREAD_ALPHA,
+        BMPREAD_SCALE_2 | BMPREAD_SCALE_AVERAGE | BMPREAD_FLOAT
+    };
+    enum { COUNT = sizeof(sizes) / sizeof(sizes[0]) };
+
+    char names[COUNT][32];
+    const char * files[COUNT + 1];
+    bmpread_rect_t rects[COUNT];
+    bmpread_t atlas;
+    size_t f;
+    int i;
+
+    for(i = 0; i < COUNT; i++)
+    {
+        sprintf(names[i], "./atlas-%d.bmp", i);
+        WriteBitmap(names[i], sizes[i][0], sizes[i][1], i);
+        files[i] = names[i];
+    }
+
+    for(f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+    {
+        size_t planes = ((flags[f] & BMPREAD_PLANAR) ?
+                         ((flags[f] & BMPREAD_ALPHA) ? 4 :
+                          (flags[f] & BMPREAD_GRAY) ? 1 : 3) : 1);
+        size_t b;
+
+        assert(bmpread_atlas(files, COUNT, flags[f], 32, &atlas, rects));
+        assert(atlas.width == 32);
+        assert(atlas.flags == flags[f]);
+        assert(atlas.levels == 1);
+        if(!(flags[f] & BMPREAD_ANY_SIZE))
+            assert(IsPowerOf2(atlas.height));
+
+        for(i = 0; i < COUNT; i++)
+        {
+            size_t pixel_span;
+            size_t p;
+            bmpread_t bmp;
+            int j;
+            int y;
+
+            assert(bmpread(files[i], flags[f] | BMPREAD_ANY_SIZE, &bmp));
+            assert(rects[i].width == bmp.width);
+            assert(rects[i].height == bmp.height);
+            assert(rects[i].x >= 0 && rects[i].x + rects[i].width <= 32);
+            assert(rects[i].y >= 0 &&
+                   rects[i].y + rects[i].height <= atlas.height);
+
+            /* No two images overlap. */
+            for(j = 0; j < i; j++)
+                assert(rects[i].x >= rects[j].x + rects[j].width ||
+                       rects[j].x >= rects[i].x + rects[i].width ||
+                       rects[i].y >= rects[j].y + rects[j].height ||
+                       rects[j].y >= rects[i].y + rects[i].height);
+
+            pixel_span = PixelBytes(&bmp) / bmp.width;
+            for(p = 0; p < planes; p++)
+            {
+                for(y = 0; y < bmp.height; y++)
+                    assert(!memcmp(atlas.data +
+                                   p * LineLength(&atlas) * atlas.height +
+                                   (rects[i].y + y) * LineLength(&atlas) +
+                                   rects[i].x * pixel_span,
+                                   bmp.data +
+                                   p * LineLength(&bmp) * bmp.height +
+                                   y * LineLength(&bmp),
+                                   PixelBytes(&bmp)));
+            }
+            bmpread_free(&bmp);
+        }
+
+        /* Everything no image covers is left 0. */
+        for(b = 0; b < planes; b++)
+        {
+            size_t pixel_span = PixelBytes(&atlas) / atlas.width;
+            int x;
+            int y;
+
+            for(y = 0; y < atlas.height; y++)
+            {
+                for(x = 0; x < atlas.width; x++)
+                {
+                    const uint8_t * p_pixel = atlas.data +
+                        b * LineLength(&atlas) * atlas.height +
+                        y * LineLength(&atlas) + x * pixel_span;
+                    size_t c;
+
+                    for(i = 0; i < COUNT; i++)
+                    {
+                        const bmpread_rect_t * r = &rects[i];
+
+                        if(x >= r->x && x < r->x + r->width &&
+                           y >= r->y && y < r->y + r->height)
+                            break;
+                    }
+                    for(c = 0; i == COUNT && c < pixel_span; c++)
+                        assert(!p_pixel[c]);
+                }
+            }
+        }
+        bmpread_free(&atlas);
+    }
+
+    /* The atlas's width has to hold every image, and be a power of 2 unless
+     * BMPREAD_ANY_SIZE is set.
+     */
+    assert(!bmpread_atlas(files, COUNT, 0, 16, &atlas, rects));
+    assert(!bmpread_atlas(files, COUNT, 0, 48, &atlas, rects));
+    assert(bmpread_atlas(files, COUNT, BMPREAD_ANY_SIZE, 48, &atlas, rects));
+    bmpread_free(&atlas);
+    assert(!bmpread_atlas(files, COUNT, BMPREAD_INDEXED, 32, &atlas, rects));
+    assert(!bmpread_atlas(files, 0, 0, 32, &atlas, rects));
+
+    files[COUNT] = "./does-not-exist.bmp";
+    assert(!bmpread_atlas(files + 1, COUNT, 0, 32, &atlas, rects));
+    assert(!atlas.data);
+
+    for(i = 0; i < COUNT; i++)
+        remove(names[i]);
+}
+
+static void test_scaling(void)
+{
+    static const unsigned int scales[] =
+    {
+        BMPREAD_SCALE_2, BMPREAD_SCALE_4, BMPREAD_SCALE_8
+    };
+
+    const char * const * file;
+    size_t i;
+
+    for(file = test_bitmaps; *file; file++)
+    {
+        bmpread_t whole;
+        unsigned int flags = BMPREAD_ANY_SIZE | BMPREAD_ALPHA;
+        assert(bmpread(*file, flags, &whole));
+
+        for(i = 0; i < sizeof(scales) / sizeof(scales[0]); i++)
+        {
+            int scale = 1 << (scales[i] / BMPREAD_SCALE_2);
+            bmpread_t nearest;
+            bmpread_t average;
+            int x;
+            int y;
+            int c;
+
+            /* A region that doesn't divide evenly into blocks. */
+            assert(bmpread_region(*file, flags | scales[i],
+                                  3, 5, 99, 77, &nearest));
+            assert(bmpread_region(*file,
+                                  flags | scales[i] | BMPREAD_SCALE_AVERAGE,
+                                  3, 5, 99, 77, &average));
+            assert(nearest.width  == (99 + scale - 1) / scale);
+            assert(nearest.height == (77 + scale - 1) / scale);
+            assert(average.width  == nearest.width);
+            assert(average.height == nearest.height);
+
+            for(y = 0; y < nearest.height; y++)
+            {
+                for(x = 0; x < nearest.width; x++)
+                {
+                    const unsigned char * p_near = nearest.data +
+                        y * LineLength(&nearest) + x * 4;
+                    const unsigned char * p_avg = average.data +
+                        y * LineLength(&average) + x * 4;
+
+                    for(c = 0; c < 4; c++)
+                    {
+                        unsigned int sum = 0;
+                        unsigned int count = 0;
+                        int bx;
+                        int by;
+
+                        for(by = y * scale; by < (y + 1) * scale && by < 77;
+                            by++)
+                        {
+                            for(bx = x * scale;
+                                bx < (x + 1) * scale && bx < 99; bx++)
+                            {
+                                sum += whole.data[(5 + by) *
+                                                  LineLength(&whole) +
+                                                  (3 + bx) * 4 + c];
+                                count++;
+                            }
+                        }
+
+                        assert(p_near[c] == whole.data[(5 + y * scale) *
+                                                       LineLength(&whole) +
+                                                       (3 + x * scale) * 4 +
+                                                       c]);
+                        assert(p_avg[c] == (sum + count / 2) / count);
+                    }
+                }
+            }
+
+            bmpread_free(&nearest);
+            bmpread_free(&average);
+        }
+
+        bmpread_free(&whole);
+    }
+}
+
+static void test_bmpread_tiles_open(void)
+{
+    static const unsigned int flags[] =
+    {
+        BMPREAD_ANY_SIZE, BMPREAD_ANY_SIZE | BMPREAD_TOP_DOWN | BMPREAD_ALPHA,
+        BMPREAD_ANY_SIZE | BMPREAD_SCALE_2 | BMPREAD_SCALE_AVERAGE
+    };
+
+    const char * const * file;
+    size_t i;
+
+    for(file = test_bitmaps; *file; file++)
+    {
+        for(i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+        {
+            bmpread_t whole;
+            bmpread_t info;
+            bmpread_tiles_t * p_tiles;
+            size_t pixel_span;
+            int pass;
+
+            assert(bmpread(*file, flags[i], &whole));
+            pixel_span = PixelBytes(&whole) / whole.width;
+
+            /* 30 doesn't divide the image evenly, and the cache only holds a
+             * few tiles, so the second pass is a mix of hits and misses.
+             */
+            assert((p_tiles = bmpread_tiles_open(*file, flags[i], 30,
+                                                 3 * 30 * 30 * 4, &info)));
+            assert(info.width == whole.width);
+            assert(info.height == whole.height);
+            assert(!info.data);
+
+            for(pass = 0; pass < 2; pass++)
+            {
+                int column = 0;
+                int row;
+
+                for(row = 0; row * 30 < whole.height; row++)
+                {
+                    for(column = 0; column * 30 < whole.width; column++)
+                    {
+                        bmpread_t tile;
+                        int y;
+
+                        assert(bmpread_tile(p_tiles, column, row, &tile));
+                        assert(tile.width  == ((whole.width - column * 30 < 30)
+                                               ? whole.width - column * 30
+                                               : 30));
+                        assert(tile.height == ((whole.height - row * 30 < 30)
+                                               ? whole.height - row * 30
+                                               : 30));
+
+                        for(y = 0; y < tile.height; y++)
+                        {
+                            assert(!memcmp(tile.data + y * LineLength(&tile),
+                                           whole.data + (row * 30 + y) *
+                                                        LineLength(&whole) +
+                                                        column * 30 *
+                                                        pixel_span,
+                                           PixelBytes(&tile)));
+                        }
+                    }
+                }
+                {
+                    bmpread_t tile;
+                    assert(!bmpread_tile(p_tiles, column, 0, &tile));
+                    assert(!bmpread_tile(p_tiles, 0, row, &tile));
+                    assert(!bmpread_tile(p_tiles, -1, 0, &tile));
+                }
+            }
+
+            bmpread_tiles_close(p_tiles);
+            bmpread_free(&whole);
+        }
+    }
+
+    {
+        bmpread_t info;
+        assert(!bmpread_tiles_open(test_bitmaps[0], 0, 30, 0, &info));
+        assert(!bmpread_tiles_open(test_bitmaps[0], 0, 0, 0, &info));
+    }
+}
+
+/* Finds a component of bmpread()'s output, by its column and line as the
+ * image is seen, top line first.
+ */
+static const uint8_t * ComponentAt(const bmpread_t * p_bmp,
+                                   int x,
+                                   int y,
+                                   size_t c)
+{
+    size_t channels = ((p_bmp->flags & BMPREAD_GRAY) ? 1 : 3);
+    size_t size     = ComponentBytes(p_bmp);
+    size_t line     = (size_t)((p_bmp->flags & BMPREAD_TOP_DOWN) ?
+                               y : p_bmp->height - 1 - y);
+
+    if(p_bmp->flags & BMPREAD_ALPHA)
+        channels++;
+    if(p_bmp->flags & BMPREAD_ALPHA_ONLY)
+        channels = 1;
+
+    if(p_bmp->flags & BMPREAD_PLANAR)
+        return p_bmp->data + (c * p_bmp->height + line) * LineLength(p_bmp) +
+                             x * size;
+    return p_bmp->data + line * LineLength(p_bmp) + (x * channels + c) * size;
+}
+
+static void test_orientation(void)
+{
+    static const unsigned int flags[] =
+    {
+        0,
+        BMPREAD_TOP_DOWN | BMPREAD_ALPHA,
+        BMPREAD_PLANAR | BMPREAD_ALPHA | BMPREAD_BYTE_ALIGN,
+        BMPREAD_UINT16 | BMPREAD_TOP_DOWN | BMPREAD_PLANAR,
+        BMPREAD_GRAY | BMPREAD_SCALE_2 | BMPREAD_SCALE_AVERAGE
+    };
+    static const unsigned int orientations[] =
+    {
+        BMPREAD_MIRROR, BMPREAD_ROTATE_90, BMPREAD_ROTATE_180,
+        BMPREAD_ROTATE_270, BMPREAD_MIRROR | BMPREAD_ROTATE_90,
+        BMPREAD_MIRROR | BMPREAD_ROTATE_270
+    };
+
+    /* In the turned image's coordinates, and not square. */
+    static const int regions[][4] =
+    {
+        {3, 5, 7, 9}, {121, 1, 7, 126}, {0, 100, 128, 28}
+    };
+
+    static max_align scratch[SCRATCH_ITEMS];
+    static float data[128 * 128 * 4];
+    bmpread_stream_t * p_stream;
+    bmpread_tiles_t * p_tiles;
+    bmpread_t info;
+    FILE * fp;
+    const char * const * file;
+    size_t f;
+    size_t o;
+    size_t j;
+
+    for(file = test_bitmaps; *file; file++)
+    {
+        for(f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            bmpread_t plain;
+            size_t channels;
+            size_t size;
+
+            assert(bmpread(*file, flags[f], &plain));
+            size     = ComponentBytes(&plain);
+            channels = PixelBytes(&plain) / plain.width / size;
+            if(flags[f] & BMPREAD_PLANAR)
+                channels = ((flags[f] & BMPREAD_ALPHA) ? 4 : 3);
+
+            for(o = 0; o < sizeof(orientations) / sizeof(orientations[0]); o++)
+            {
+                unsigned int turn = orientations[o] & BMPREAD_ROTATE_270;
+                bmpread_t turned;
+                int x;
+                int y;
+
+                assert(bmpread(*file, flags[f] | orientations[o], &turned));
+                assert(turned.width == ((turn & BMPREAD_ROTATE_90) ?
+                                        plain.height : plain.width));
+                assert(turned.height == ((turn & BMPREAD_ROTATE_90) ?
+                                         plain.width : plain.height));
+
+                for(y = 0; y < turned.height; y++)
+                {
+                    for(x = 0; x < turned.width; x++)
+                    {
+                        int px = x;
+                        int py = y;
+                        size_t c;
+
+                        if(turn == BMPREAD_ROTATE_90)
+                        {
+                            px = y;
+                            py = plain.height - 1 - x;
+                        }
+                        else if(turn == BMPREAD_ROTATE_180)
+                        {
+                            px = plain.width - 1 - x;
+                            py = plain.height - 1 - y;
+                        }
+                        else if(turn == BMPREAD_ROTATE_270)
+                        {
+                            px = plain.width - 1 - y;
+                            py = x;
+                        }
+                        if(orientations[o] & BMPREAD_MIRROR)
+                            px = plain.width - 1 - px;
+
+                        for(c = 0; c < channels; c++)
+                            assert(!memcmp(ComponentAt(&turned, x, y, c),
+                                           ComponentAt(&plain, px, py, c),
+                                           size));
+                    }
+                }
+
+                /* Regions are cut out of the turned image. */
+                if(!(flags[f] & (BMPREAD_PLANAR | BMPREAD_SCALE_2)))
+                {
+                    size_t pixel_span = PixelBytes(&turned) / turned.width;
+
+                    for(j = 0; j < sizeof(regions) / sizeof(regions[0]); j++)
+                    {
+                        const int * r = regions[j];
+                        bmpread_t region;
+
+                        assert(bmpread_region(*file,
+                                              flags[f] | orientations[o] |
+                                              BMPREAD_ANY_SIZE,
+                                              r[0], r[1], r[2], r[3],
+                                              &region));
+                        assert(region.width == r[2]);
+                        assert(region.height == r[3]);
+
+                        for(y = 0; y < region.height; y++)
+                        {
+                            assert(!memcmp(region.data +
+                                           y * LineLength(&region),
+                                           turned.data +
+                                           (r[1] + y) * LineLength(&turned) +
+                                           r[0] * pixel_span,
+                                           PixelBytes(&region)));
+                        }
+                        bmpread_free(&region);
+                    }
+                }
+
+                bmpread_free(&turned);
+            }
+
+            bmpread_free(&plain);
+        }
+    }
+
+    /* Streams and tiles can mirror and flip, but can't turn lines into
+     * columns.
+     */
+    {
+        bmpread_t turned;
+        bmpread_t tile;
+        int y;
+
+        assert(bmpread(test_bitmaps[7], BMPREAD_ROTATE_180 | BMPREAD_ALPHA,
+                       &turned));
+        assert((p_stream = bmpread_open(test_bitmaps[7],
+                                        BMPREAD_ROTATE_180 | BMPREAD_ALPHA,
+                                        &info)));
+        for(y = 0; y < turned.height; y++)
+        {
+            const uint8_t * p_row = bmpread_next_row(p_stream);
+            assert(p_row);
+            assert(!memcmp(p_row, turned.data + y * LineLength(&turned),
+                           PixelBytes(&turned)));
+        }
+        bmpread_close(p_stream);
+        bmpread_free(&turned);
+
+        assert(bmpread_region(test_bitmaps[6], BMPREAD_MIRROR,
+                              32, 16, 16, 16, &turned));
+        assert((p_tiles = bmpread_tiles_open(test_bitmaps[6], BMPREAD_MIRROR,
+                                             16, 1 << 16, &info)));
+        assert(bmpread_tile(p_tiles, 2, 1, &tile));
+        assert(!memcmp(tile.data, turned.data, LineLength(&turned) * 16));
+        bmpread_tiles_close(p_tiles);
+        bmpread_free(&turned);
+
+        assert(!bmpread_open(test_bitmaps[6], BMPREAD_ROTATE_90, &info));
+        assert(!bmpread_tiles_open(test_bitmaps[6], BMPREAD_ROTATE_270,
+                                   16, 1 << 16, &info));
+    }
+
+    /* Everything above compares orientations with each other, so check that
+     * unturned lines keep the file's order too: the example files are stored
+     * bottom line first, which is also the default output order.
+     */
+    assert((fp = fopen(test_bitmaps[6], "rb")));
+    assert(!fseek(fp, 54, SEEK_SET));
+    assert(fread(data, 128 * 3, 128, fp) == 128);
+    fclose(fp);
+    assert(bmpread(test_bitmaps[6], BMPREAD_BGR, &info));
+    assert(!memcmp(info.data, data, LineLength(&info) * info.height));
+    bmpread_free(&info);
+    assert(bmpread(test_bitmaps[6], BMPREAD_BGR | BMPREAD_TOP_DOWN, &info));
+    for(j = 0; j < 128; j++)
+        assert(!memcmp(info.data + j * LineLength(&info),
+                       (const uint8_t *)data + (127 - j) * LineLength(&info),
+                       LineLength(&info)));
+    bmpread_free(&info);
+
+    /* Turning's band of lines still fits in the most scratch memory. */
+    assert((fp = fopen("../example/example-32bpp-a8r8g8b8.bmp", "rb")));
+    assert(bmpread_into(fp, BMPREAD_FLOAT | BMPREAD_ALPHA | BMPREAD_SCALE_2 |
+                            BMPREAD_SCALE_AVERAGE | BMPREAD_ROTATE_90,
+                        scratch, BMPREAD_SCRATCH_SIZE(128),
+                        (unsigned char *)data, sizeof(data), &info));
+    fclose(fp);
+}
+
+/* Reads a component of bmpread()'s output as a number, on the scale it's
+ * stored on.
+ */
+static double ComponentValue(const bmpread_t * p_bmp, int x, int y, size_t c)
+{
+    const uint8_t * p = ComponentAt(p_bmp, x, y, c);
+
+    if(ComponentBytes(p_bmp) == sizeof(float))
+        return *(const float *)(const void *)p;
+    if(ComponentBytes(p_bmp) == sizeof(uint16_t))
+        return *(const uint16_t *)(const void *)p;
+    return *p;
+}
+
+/* Checks each mipmap level of the given image is the level before it,
+ * averaged 2x2.  Pairs of lines are counted from whichever comes first, so
+ * only top down output is checked with odd heights.
+ */
+static void CheckMipmaps(const bmpread_t * p_bmp)
+{
+    size_t channels = ((p_bmp->flags & BMPREAD_GRAY) ? 1 : 3);
+    bmpread_t from;
+    bmpread_t to;
+    int n;
+
+    if(p_bmp->flags & BMPREAD_ALPHA)
+        channels++;
+    if(p_bmp->flags & BMPREAD_ALPHA_ONLY)
+        channels = 1;
+
+    assert(!bmpread_level(p_bmp, -1, &to));
+    assert(!bmpread_level(p_bmp, p_bmp->levels, &to));
+    assert(bmpread_level(p_bmp, 0, &from));
+    assert(from.data == p_bmp->data);
+    assert(from.levels == 1);
+
+    for(n = 1; n < p_bmp->levels; n++)
+    {
+        int x;
+        int y;
+
+        assert(bmpread_level(p_bmp, n, &to));
+        assert(to.width == ((from.width > 1) ? from.width / 2 : 1));
+        assert(to.height == ((from.height > 1) ? from.height / 2 : 1));
+        assert(to.data >= from.data + LineLength(&from) * from.height *
+                                      ((from.flags & BMPREAD_PLANAR) ?
+                                       channels : 1));
+
+        for(y = 0; y < to.height; y++)
+        {
+            for(x = 0; x < to.width; x++)
+            {
+                size_t c;
+                for(c = 0; c < channels; c++)
+                {
+                    int bx = ((from.width > 1) ? 2 : 1);
+                    int by = ((from.height > 1) ? 2 : 1);
+                    double sum = 0;
+                    int i;
+                    int j;
+
+                    for(j = 0; j < by; j++)
+                        for(i = 0; i < bx; i++)
+                            sum += ComponentValue(&from, x * bx + i,
+                                                  y * by + j, c);
+                    sum /= bx * by;
+
+                    if(ComponentBytes(&from) == sizeof(float))
+                        assert(ComponentValue(&to, x, y, c) - sum < 0.00001 &&
+                               sum - ComponentValue(&to, x, y, c) < 0.00001);
+                    else
+                        assert(ComponentValue(&to, x, y, c) ==
+                               (double)(long)(sum + 0.5));
+                }
+            }
+        }
+
+        from = to;
+    }
+
+    assert(from.width == 1 && from.height == 1);
+}
+
+static void test_BMPREAD_MIPMAPS(void)
+{
+    static const unsigned int flags[] =
+    {
+        0,
+        BMPREAD_TOP_DOWN | BMPREAD_ALPHA | BMPREAD_PLANAR,
+        BMPREAD_UINT16 | BMPREAD_GRAY | BMPREAD_BYTE_ALIGN,
+        BMPREAD_FLOAT | BMPREAD_ALPHA_ONLY | BMPREAD_ROTATE_90
+    };
+
+    static max_align scratch[SCRATCH_ITEMS];
+    static uint8_t data[128 * 128 * 3 * 2];
+    const char * const * file;
+    bmpread_t plain;
+    bmpread_t mipmaps;
+    bmpread_t level;
+    size_t f;
+    FILE * fp;
+
+    for(file = test_bitmaps; *file; file++)
+    {
+        for(f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            assert(bmpread(*file, flags[f], &plain));
+            assert(plain.levels == 1);
+            assert(bmpread(*file, flags[f] | BMPREAD_MIPMAPS, &mipmaps));
+            assert(mipmaps.levels == 8);
+            assert(!memcmp(mipmaps.data, plain.data,
+                           LineLength(&plain) * plain.height *
+                           ((flags[f] & BMPREAD_PLANAR) ? 4 : 1)));
+            CheckMipmaps(&mipmaps);
+            bmpread_free(&mipmaps);
+            bmpread_free(&plain);
+        }
+    }
+
+    /* Odd and uneven sizes, and files read whole or in bands. */
+    assert(bmpread_region(test_bitmaps[6], BMPREAD_MIPMAPS | BMPREAD_ANY_SIZE |
+                                           BMPREAD_TOP_DOWN | BMPREAD_BGR,
+                          5, 7, 37, 100, &mipmaps));
+    assert(mipmaps.levels == 7);
+    CheckMipmaps(&mipmaps);
+    bmpread_free(&mipmaps);
+
+    assert(bmpread(test_bitmaps[6], BMPREAD_MIPMAPS | BMPREAD_BGR, &mipmaps));
+    CheckMipmaps(&mipmaps);
+    bmpread_free(&mipmaps);
+
+    assert(bmpread_resized(test_bitmaps[7], BMPREAD_MIPMAPS | BMPREAD_ALPHA |
+                                            BMPREAD_MIRROR,
+                           256, 16, &mipmaps));
+    assert(mipmaps.levels == 9);
+    CheckMipmaps(&mipmaps);
+    assert(bmpread_level(&mipmaps, 8, &level));
+    assert(level.width == 1 && level.height == 1);
+    bmpread_free(&mipmaps);
+
+    /* Caller memory has to hold every level. */
+    assert((fp = fopen(test_bitmaps[6], "rb")));
+    assert(!bmpread_into(fp, BMPREAD_MIPMAPS, scratch, sizeof(scratch),
+                         data, 128 * 128 * 3, &mipmaps));
+    assert(bmpread_into(fp, BMPREAD_MIPMAPS, scratch, sizeof(scratch),
+                        data, sizeof(data), &mipmaps));
+    CheckMipmaps(&mipmaps);
+    fclose(fp);
+
+    assert(!bmpread(test_bitmaps[2], BMPREAD_MIPMAPS | BMPREAD_INDEXED,
+                    &mipmaps));
+    assert(!bmpread_open(test_bitmaps[6], BMPREAD_MIPMAPS, &mipmaps));
+    assert(!bmpread_tiles_open(test_bitmaps[6], BMPREAD_MIPMAPS, 16, 1 << 16,
+                               &mipmaps));
+    assert(!bmpread_level(NULL, 0, &level));
+}
+
+/* Finds a component of bmpread()'s output by its column and by its line in
+ * the order lines are output.
+ */
+static const uint8_t * OutputComponentAt(const bmpread_t * p_bmp,
+                                         int x,
+                                         int line,
+                                         size_t c)
+{
+    return ComponentAt(p_bmp, x, ((p_bmp->flags & BMPREAD_TOP_DOWN) ?
+                                  line : p_bmp->height - 1 - line), c);
+}
+
+/* Checks the given padded output holds the given image, loaded without
+ * padding, in its first columns and lines, and 0 or copies of the image's
+ * edge after them.
+ */
+static void CheckPadding(const bmpread_t * p_bmp, const bmpread_t * p_image)
+{
+    size_t channels = ((p_bmp->flags & BMPREAD_GRAY) ? 1 : 3);
+    size_t size     = ComponentBytes(p_bmp);
+    int    clamp    = ((p_bmp->flags & BMPREAD_PAD_CLAMP) ? 1 : 0);
+    int    line;
+
+    if(p_bmp->flags & BMPREAD_ALPHA)
+        channels++;
+    if(p_bmp->flags & BMPREAD_ALPHA_ONLY)
+        channels = 1;
+
+    assert(p_bmp->image_width  == p_image->width);
+    assert(p_bmp->image_height == p_image->height);
+    assert(IsPowerOf2(p_bmp->width) && IsPowerOf2(p_bmp->height));
+    assert(p_bmp->width  >= p_image->width  &&
+           p_bmp->width  / 2 < p_image->width);
+    assert(p_bmp->height >= p_image->height &&
+           p_bmp->height / 2 < p_image->height);
+
+    for(line = 0; line < p_bmp->height; line++)
+    {
+        int from_line = ((line < p_image->height) ? line :
+                         clamp ? p_image->height - 1 : -1);
+        int x;
+
+        for(x = 0; x < p_bmp->width; x++)
+        {
+            int from_x = ((x < p_image->width) ? x :
+                          clamp ? p_image->width - 1 : -1);
+            size_t c;
+
+            for(c = 0; c < channels; c++)
+            {
+                const uint8_t * p = OutputComponentAt(p_bmp, x, line, c);
+                size_t b;
+
+                if(from_x >= 0 && from_line >= 0)
+                    assert(!memcmp(p, OutputComponentAt(p_image, from_x,
+                                                        from_line, c),
+                                   size));
+                else
+                    for(b = 0; b < size; b++)
+                        assert(p[b] == 0);
+            }
+        }
+    }
+}
+
+static void test_BMPREAD_PAD_POW2(void)
+{
+    static const int sizes[][2] = {{5, 3}, {4, 3}, {8, 5}, {1, 1}, {33, 17}};
+    static const unsigned int flags[] =
+    {
+        0,
+        BMPREAD_BGR,
+        BMPREAD_TOP_DOWN | BMPREAD_ALPHA | BMPREAD_PLANAR,
+        BMPREAD_UINT16 | BMPREAD_GRAY | BMPREAD_BYTE_ALIGN,
+        BMPREAD_FLOAT | BMPREAD_MIRROR | BMPREAD_ROTATE_90,
+        BMPREAD_TOP_DOWN | BMPREAD_SCALE_2 | BMPREAD_SCALE_AVERAGE
+    };
+    static const unsigned int pads[] =
+    {
+        BMPREAD_PAD_POW2,
+        BMPREAD_PAD_POW2 | BMPREAD_PAD_CLAMP
+    };
+
+    const char * const name = "./pad.bmp";
+    const char * const * file;
+    bmpread_rect_t rect;
+    bmpread_t image;
+    bmpread_t padded;
+    bmpread_t level;
+    size_t s;
+    size_t f;
+    size_t p;
+
+    for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        WriteBitmap(name, sizes[s][0], sizes[s][1], (int)s);
+
+        for(f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            assert(bmpread(name, flags[f] | BMPREAD_ANY_SIZE, &image));
+
+            for(p = 0; p < sizeof(pads) / sizeof(pads[0]); p++)
+            {
+                assert(bmpread(name, flags[f] | pads[p], &padded));
+                CheckPadding(&padded, &image);
+                bmpread_free(&padded);
+
+                /* The padding's mipmaps are made too, whichever order the
+                 * lines come in.
+                 */
+                assert(bmpread(name, flags[f] | pads[p] | BMPREAD_MIPMAPS,
+                               &padded));
+                assert(bmpread_level(&padded, 0, &level));
+                CheckPadding(&level, &image);
+                CheckMipmaps(&padded);
+                bmpread_free(&padded);
+            }
+
+            bmpread_free(&image);
+        }
+    }
+
+    /* Padding shrinks with each mipmap level. */
+    WriteBitmap(name, 5, 3, 0);
+    assert(bmpread(name, BMPREAD_PAD_POW2 | BMPREAD_MIPMAPS, &padded));
+    assert(padded.levels == 4);
+    assert(bmpread_level(&padded, 1, &level));
+    assert(level.width == 4 && level.height == 2);
+    assert(level.image_width == 3 && level.image_height == 2);
+    assert(bmpread_level(&padded, 2, &level));
+    assert(level.image_width == 2 && level.image_height == 1);
+    assert(bmpread_level(&padded, 3, &level));
+    assert(level.image_width == 1 && level.image_height == 1);
+    bmpread_free(&padded);
+
+    /* Without padding, the file still has to be a power of 2, and streams,
+     * tiles, and atlases don't pad.
+     */
+    assert(!bmpread(name, 0, &padded));
+    assert(!bmpread(name, BMPREAD_PAD_CLAMP, &padded));
+    assert(!bmpread_open(name, BMPREAD_PAD_POW2, &padded));
+    assert(!bmpread_tiles_open(name, BMPREAD_PAD_POW2, 2, 1 << 16, &padded));
+    assert(bmpread_atlas(&name, 1, 0, 8, &padded, &rect));
+    bmpread_free(&padded);
+    assert(!bmpread_atlas(&name, 1, BMPREAD_PAD_POW2, 8, &padded, &rect));
+    remove(name);
+
+    /* Regions and resized images are padded too. */
+    assert(bmpread_region(test_bitmaps[6], BMPREAD_ANY_SIZE | BMPREAD_TOP_DOWN,
+                          3, 5, 37, 100, &image));
+    assert(bmpread_region(test_bitmaps[6],
+                          BMPREAD_PAD_POW2 | BMPREAD_PAD_CLAMP |
+                          BMPREAD_TOP_DOWN,
+                          3, 5, 37, 100, &padded));
+    assert(padded.width == 64 && padded.height == 128);
+    CheckPadding(&padded, &image);
+    bmpread_free(&padded);
+    bmpread_free(&image);
+
+    assert(bmpread_resized(test_bitmaps[7], BMPREAD_ANY_SIZE | BMPREAD_ALPHA,
+                           100, 50, &image));
+    for(p = 0; p < sizeof(pads) / sizeof(pads[0]); p++)
+    {
+        assert(bmpread_resized(test_bitmaps[7], pads[p] | BMPREAD_ALPHA,
+                               100, 50, &padded));
+        CheckPadding(&padded, &image);
+        bmpread_free(&padded);
+    }
+    bmpread_free(&image);
+
+    /* Images that are already powers of 2 aren't changed. */
+    for(file = test_bitmaps; *file; file++)
+    {
+        assert(bmpread(*file, 0, &image));
+        assert(bmpread(*file, BMPREAD_PAD_POW2, &padded));
+        assert(padded.width == 128 && padded.image_width == 128);
+        assert(padded.height == 128 && padded.image_height == 128);
+        assert(!memcmp(padded.data, image.data, LineLength(&image) * 128));
+        bmpread_free(&padded);
+        bmpread_free(&image);
+    }
+}
+
+/* A plain CRC-32C, a bit at a time, continuing from crc. */
+static uint32_t Crc32c(uint32_t crc, const uint8_t * p, size_t len)
+{
+    int k;
+
+    crc = ~crc;
+    for(; len; len--, p++)
+    {
+        crc ^= *p;
+        for(k = 0; k < 8; k++)
+            crc = ((crc & 1) ? (crc >> 1) ^ UINT32_C(0x82f63b78) : crc >> 1);
+    }
+    return ~crc;
+}
+
+/* The CRC-32C of bmpread()'s output, one line at a time in data's order. */
+static unsigned long ExpectedChecksum(const bmpread_t * p_bmp)
+{
+    size_t planes = ((p_bmp->flags & BMPREAD_GRAY) ? 1 : 3);
+    uint32_t crc  = 0;
+    size_t line;
+
+    if(p_bmp->flags & BMPREAD_ALPHA)
+        planes++;
+    if(!(p_bmp->flags & BMPREAD_PLANAR) ||
+       (p_bmp->flags & (BMPREAD_ALPHA_ONLY | BMPREAD_INDEXED)))
+        planes = 1;
+
+    for(line = 0; line < planes * p_bmp->height; line++)
+        crc = Crc32c(crc, p_bmp->data + line * LineLength(p_bmp),
+                     PixelBytes(p_bmp));
+    return crc;
+}
+
+static void test_BMPREAD_CHECKSUM(void)
+{
+    static const unsigned int flags[] =
+    {
+        0,
+        BMPREAD_TOP_DOWN,
+        BMPREAD_BGR | BMPREAD_ALPHA,
+        BMPREAD_TOP_DOWN | BMPREAD_ALPHA | BMPREAD_PLANAR,
+        BMPREAD_UINT16 | BMPREAD_GRAY | BMPREAD_BYTE_ALIGN,
+        BMPREAD_FLOAT | BMPREAD_ROTATE_90 | BMPREAD_PLANAR,
+        BMPREAD_SCALE_4 | BMPREAD_SCALE_AVERAGE | BMPREAD_MIPMAPS,
+        BMPREAD_INDEXED
+    };
+
+    static max_align scratch[SCRATCH_ITEMS];
+    static unsigned char data[128 * 128 * 4];
+    const char * const * file;
+    bmpread_rect_t rect;
+    bmpread_t bmp;
+    bmpread_t plain;
+    size_t f;
+    FILE * fp;
+
+    assert(Crc32c(0, (const uint8_t *)"123456789", 9) == UINT32_C(0xe3069283));
+
+    for(file = test_bitmaps; *file; file++)
+    {
+        for(f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            if((flags[f] & BMPREAD_INDEXED) && file - test_bitmaps > 2)
+                continue;
+
+            assert(bmpread(*file, flags[f], &plain));
+            assert(plain.checksum == 0);
+            assert(bmpread(*file, flags[f] | BMPREAD_CHECKSUM, &bmp));
+            assert(bmp.checksum == ExpectedChecksum(&plain));
+            assert(bmp.checksum != 0);
+            bmpread_free(&bmp);
+
+            /* Line padding is left out. */
+            assert(bmpread(*file, flags[f] | BMPREAD_CHECKSUM |
+                                  BMPREAD_BYTE_ALIGN, &bmp));
+            assert(bmp.checksum == ExpectedChecksum(&plain));
+            bmpread_free(&bmp);
+            bmpread_free(&plain);
+        }
+    }
+
+    /* Regions, padding, and resized images, in bands and out of order. */
+    assert(bmpread_region(test_bitmaps[6],
+                          BMPREAD_ANY_SIZE | BMPREAD_TOP_DOWN |
+                          BMPREAD_CHECKSUM,
+                          3, 5, 37, 100, &bmp));
+    assert(bmp.checksum == ExpectedChecksum(&bmp));
+    bmpread_free(&bmp);
+
+    assert(bmpread_region(test_bitmaps[7],
+                          BMPREAD_PAD_POW2 | BMPREAD_PAD_CLAMP |
+                          BMPREAD_ALPHA | BMPREAD_PLANAR |
+                          BMPREAD_TOP_DOWN | BMPREAD_CHECKSUM,
+                          3, 5, 37, 100, &bmp));
+    assert(bmp.checksum == ExpectedChecksum(&bmp));
+    bmpread_free(&bmp);
+
+    assert(bmpread_resized(test_bitmaps[8], BMPREAD_ANY_SIZE | BMPREAD_GRAY |
+                                            BMPREAD_CHECKSUM,
+                           100, 37, &bmp));
+    assert(bmp.checksum == ExpectedChecksum(&bmp));
+    bmpread_free(&bmp);
+
+    /* Caller memory has room for hashing. */
+    assert((fp = fopen(test_bitmaps[6], "rb")));
+    assert(bmpread_into(fp, BMPREAD_ALPHA | BMPREAD_CHECKSUM,
+                        scratch, sizeof(scratch), data, sizeof(data), &bmp));
+    assert(bmp.checksum == ExpectedChecksum(&bmp));
+    fclose(fp);
+
+    assert(!bmpread_open(test_bitmaps[6], BMPREAD_CHECKSUM, &bmp));
+    assert(!bmpread_tiles_open(test_bitmaps[6], BMPREAD_CHECKSUM, 16, 1 << 16,
+                               &bmp));
+    assert(!bmpread_atlas(&test_bitmaps[6], 1, BMPREAD_CHECKSUM, 128, &bmp,
+                          &rect));
+}
+
+/* Checks the given statistics against ones worked out from bmpread()'s
+ * output for the same image and flags, without BMPREAD_INDEXED.
+ */
+static void CheckStats(const bmpread_stats_t * p_stats,
+                       const bmpread_t * p_bmp)
+{
+    int    channels = ((p_bmp->flags & BMPREAD_GRAY) ? 1 : 3);
+    int    alpha    = -1;
+    double full     = ((p_bmp->flags & BMPREAD_FLOAT)  ? 1 :
+                       (p_bmp->flags & BMPREAD_UINT16) ? 65535 : 255);
+    double pixels   = (double)p_bmp->width * p_bmp->height;
+    int    c;
+
+    if(p_bmp->flags & BMPREAD_ALPHA)
+    {
+        alpha = ((p_bmp->flags & BMPREAD_ALPHA_FIRST) ? 0 : channels);
+        channels++;
+    }
+    if(p_bmp->flags & BMPREAD_ALPHA_ONLY)
+    {
+        alpha    = 0;
+        channels = 1;
+    }
+
+    assert(p_stats->channels == channels);
+    assert(p_stats->alpha    == alpha);
+    assert(p_stats->opaque   == (alpha < 0 || p_stats->min[alpha] >= full));
+
+    for(c = 0; c < 4; c++)
+    {
+        unsigned long histogram[256];
+        double min  = full;
+        double max  = 0;
+        double sum  = 0;
+        int    x;
+        int    y;
+
+        memset(histogram, 0, sizeof(histogram));
+        for(y = 0; c < channels && y < p_bmp->height; y++)
+        {
+            for(x = 0; x < p_bmp->width; x++)
+            {
+                double value = ComponentValue(p_bmp, x, y, (size_t)c);
+                double bin   = ((full == 65535) ? value / 257 :
+                                    (full == 1)     ? value * 255 : value);
+
+                bin = (bin > 255 ? 255 : bin < 0 ? 0 : bin);
+                histogram[(int)(bin + 0.5)]++;
+                if(value < min) min = value;
+                if(value > max) max = value;
+                sum += value;
+            }
+        }
+
+        assert(!memcmp(p_stats->histogram[c], histogram, sizeof(histogram)));
+        if(c >= channels)
+        {
+            assert(p_stats->min[c] == 0 && p_stats->max[c] == 0);
+            assert(p_stats->mean[c] == 0);
+            continue;
+        }
+        assert(p_stats->min[c] == min);
+        assert(p_stats->max[c] == max);
+        assert(p_stats->mean[c] - sum / pixels <  full / 1e6 &&
+               p_stats->mean[c] - sum / pixels > -full / 1e6);
+    }
+}
+
+static void test_BMPREAD_STATS(void)
+{
+    static const unsigned int flags[] =
+    {
+        0,
+        BMPREAD_TOP_DOWN | BMPREAD_ALPHA,
+        BMPREAD_BGR | BMPREAD_ALPHA | BMPREAD_ALPHA_FIRST | BMPREAD_PLANAR,
+        BMPREAD_GRAY | BMPREAD_BYTE_ALIGN,
+        BMPREAD_ALPHA_ONLY,
+        BMPREAD_UINT16 | BMPREAD_ALPHA | BMPREAD_ROTATE_90,
+        BMPREAD_FLOAT | BMPREAD_ALPHA | BMPREAD_PLANAR,
+        BMPREAD_SCALE_4 | BMPREAD_SCALE_AVERAGE | BMPREAD_MIPMAPS,
+        BMPREAD_INDEXED | BMPREAD_ALPHA,
+        BMPREAD_INDEXED | BMPREAD_UINT16,
+        BMPREAD_INDEXED | BMPREAD_FLOAT | BMPREAD_GRAY
+    };
+
+    static max_align scratch[SCRATCH_ITEMS];
+    static unsigned char data[128 * 128 * 4];
+    const char * const * file;
+    bmpread_rect_t rect;
+    bmpread_t bmp;
+    bmpread_t plain;
+    size_t f;
+    FILE * fp;
+
+    for(file = test_bitmaps; *file; file++)
+    {
+        for(f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            if((flags[f] & BMPREAD_INDEXED) && file - test_bitmaps > 2)
+                continue;
+
+            assert(bmpread(*file, flags[f] & ~BMPREAD_INDEXED, &plain));
+            assert(!plain.stats);
+            assert(bmpread(*file, flags[f] | BMPREAD_STATS, &bmp));
+            assert(bmp.stats);
+            CheckStats(bmp.stats, &plain);
+            bmpread_free(&bmp);
+            bmpread_free(&plain);
+        }
+    }
+
+    /* Only the file with alpha has transparent pixels. */
+    assert(bmpread(test_bitmaps[7], BMPREAD_ALPHA | BMPREAD_STATS, &bmp));
+    assert(!bmp.stats->opaque);
+    bmpread_free(&bmp);
+    assert(bmpread(test_bitmaps[8], BMPREAD_ALPHA | BMPREAD_STATS, &bmp));
+    assert(bmp.stats->opaque);
+    bmpread_free(&bmp);
+
+    /* Padding and resized images count only the image. */
+    assert(bmpread_region(test_bitmaps[7], BMPREAD_PAD_POW2 | BMPREAD_ALPHA |
+                                           BMPREAD_STATS,
+                          3, 5, 37, 100, &bmp));
+    assert(bmpread_region(test_bitmaps[7], BMPREAD_ANY_SIZE | BMPREAD_ALPHA,
+                          3, 5, 37, 100, &plain));
+    CheckStats(bmp.stats, &plain);
+    bmpread_free(&bmp);
+    bmpread_free(&plain);
+
+    assert(bmpread_resized(test_bitmaps[6], BMPREAD_ANY_SIZE | BMPREAD_STATS,
+                           100, 37, &bmp));
+    CheckStats(bmp.stats, &bmp);
+    bmpread_free(&bmp);
+
+    /* Caller memory has room for them, indexed or not. */
+    assert((fp = fopen(test_bitmaps[2], "rb")));
+    assert(bmpread_into(fp, BMPREAD_INDEXED | BMPREAD_FLOAT | BMPREAD_ALPHA |
+                            BMPREAD_STATS,
+                        scratch, sizeof(scratch), data, sizeof(data), &bmp));
+    assert(bmp.stats->channels == 4);
+    assert(bmp.stats->opaque);
+    fclose(fp);
+
+    assert(!bmpread_open(test_bitmaps[6], BMPREAD_STATS, &bmp));
+    assert(!bmpread_tiles_open(test_bitmaps[6], BMPREAD_STATS, 16, 1 << 16,
+                               &bmp));
+    assert(!bmpread_atlas(&test_bitmaps[6], 1, BMPREAD_STATS, 128, &bmp,
+                          &rect));
+}
+
+/* Checks two loads of an image have the same format and pixels, in every
+ * level, leaving out the bytes that pad lines, and the same palette.
+ */
+static void CheckSameOutput(const bmpread_t * p_bmp, const bmpread_t * p_other)
+{
+    size_t channels = ((p_bmp->flags & BMPREAD_GRAY) ? 1 : 3);
+    size_t planes;
+    size_t entry_len;
+    int    n;
+
+    if(p_bmp->flags & BMPREAD_ALPHA)
+        channels++;
+    planes    = ((p_bmp->flags & BMPREAD_PLANAR) ? channels : 1);
+    entry_len = channels *
+                ((p_bmp->flags & BMPREAD_FLOAT)  ? sizeof(float) :
+                 (p_bmp->flags & BMPREAD_UINT16) ? sizeof(uint16_t) : 1);
+    if(p_bmp->flags & (BMPREAD_ALPHA_ONLY | BMPREAD_INDEXED))
+        planes = 1;
+
+    assert(p_bmp->width  == p_other->width);
+    assert(p_bmp->height == p_other->height);
+    assert(p_bmp->flags  == p_other->flags);
+    assert(p_bmp->levels == p_other->levels);
+    assert(p_bmp->colors == p_other->colors);
+    assert(!p_bmp->colors ||
+           !memcmp(p_bmp->palette, p_other->palette,
+                   (size_t)p_bmp->colors * entry_len));
+
+    for(n = 0; n < p_bmp->levels; n++)
+    {
+        bmpread_t level;
+        bmpread_t other;
+        size_t line;
+
+        assert(bmpread_level(p_bmp, n, &level));
+        assert(bmpread_level(p_other, n, &other));
+        for(line = 0; line < planes * level.height; line++)
+            assert(!memcmp(level.data + line * LineLength(&level),
+                           other.data + line * LineLength(&other),
+                           PixelBytes(&level)));
+    }
+}
+
+static void test_BMPREAD_DROP_OPAQUE_ALPHA(void)
+{
+    static const unsigned int flags[] =
+    {
+        BMPREAD_ALPHA,
+        BMPREAD_ALPHA | BMPREAD_ALPHA_FIRST | BMPREAD_BGR | BMPREAD_TOP_DOWN,
+        BMPREAD_ALPHA | BMPREAD_PLANAR | BMPREAD_MIPMAPS,
+        BMPREAD_ALPHA | BMPREAD_ALPHA_FIRST | BMPREAD_PLANAR | BMPREAD_FLOAT,
+        BMPREAD_ALPHA | BMPREAD_GRAY | BMPREAD_BYTE_ALIGN | BMPREAD_MIPMAPS,
+        BMPREAD_ALPHA | BMPREAD_UINT16 | BMPREAD_ROTATE_90,
+        BMPREAD_ALPHA | BMPREAD_SCALE_2 | BMPREAD_SCALE_AVERAGE,
+        BMPREAD_ALPHA | BMPREAD_INDEXED | BMPREAD_ALPHA_FIRST,
+        BMPREAD_ALPHA_ONLY,
+        0
+    };
+    const unsigned int alpha = BMPREAD_ALPHA | BMPREAD_ALPHA_FIRST;
+
+    static max_align scratch[SCRATCH_ITEMS];
+    static unsigned char data[128 * 128 * 4];
+    const char * const * file;
+    bmpread_rect_t rect;
+    bmpread_t bmp;
+    bmpread_t plain;
+    bmpread_t opaque;
+    bmpread_ctx_t * p_reuse;
+    size_t f;
+    FILE * fp;
+
+    for(file = test_bitmaps; *file; file++)
+    {
+        for(f = 0; f < sizeof(flags) / sizeof(flags[0]); f++)
+        {
+            if((flags[f] & BMPREAD_INDEXED) && file - test_bitmaps > 2)
+                continue;
+
+            /* Alpha's dropped just when the stats say it's all full. */
+            assert(bmpread(*file, flags[f] | BMPREAD_STATS, &plain));
+            assert(bmpread(*file, flags[f] | BMPREAD_DROP_OPAQUE_ALPHA,
+                           &bmp));
+            if(!(flags[f] & BMPREAD_ALPHA) || !plain.stats->opaque)
+            {
+                bmp.flags &= ~BMPREAD_DROP_OPAQUE_ALPHA;
+                plain.flags &= ~BMPREAD_STATS;
+                CheckSameOutput(&bmp, &plain);
+            }
+            else
+            {
+                assert(bmpread(*file, (flags[f] & ~alpha), &opaque));
+                assert(bmp.flags == (opaque.flags |
+                                     BMPREAD_DROP_OPAQUE_ALPHA));
+                bmp.flags &= ~BMPREAD_DROP_OPAQUE_ALPHA;
+                CheckSameOutput(&bmp, &opaque);
+                bmpread_free(&opaque);
+            }
+            bmpread_free(&bmp);
+            bmpread_free(&plain);
+        }
+    }
+
+    /* Only the file with alpha keeps it. */
+    assert(bmpread(test_bitmaps[7], BMPREAD_ALPHA | BMPREAD_DROP_OPAQUE_ALPHA,
+                   &bmp));
+    assert(bmp.flags & BMPREAD_ALPHA);
+    bmpread_free(&bmp);
+
+    /* A color key makes some pixels, or palette entries, transparent. */
+    assert((p_reuse = bmpread_ctx_new()));
+    assert(bmpread(test_bitmaps[6], 0, &plain));
+    bmpread_ctx_set_color_key(p_reuse, ((long)plain.data[0] << 16) |
+                                       (plain.data[1] << 8) | plain.data[2]);
+    assert(bmpread_ctx_read(p_reuse, test_bitmaps[6],
+                            BMPREAD_ALPHA | BMPREAD_DROP_OPAQUE_ALPHA, &bmp));
+    assert(bmp.flags & BMPREAD_ALPHA);
+    bmpread_free(&plain);
+
+    assert(bmpread(test_bitmaps[1], BMPREAD_INDEXED, &plain));
+    bmpread_ctx_set_color_key(p_reuse, ((long)plain.palette[9] << 16) |
+                                       (plain.palette[10] << 8) |
+                                       plain.palette[11]);
+    assert(bmpread_ctx_read(p_reuse, test_bitmaps[1],
+                            BMPREAD_INDEXED | BMPREAD_ALPHA |
+                            BMPREAD_DROP_OPAQUE_ALPHA, &bmp));
+    assert(bmp.flags & BMPREAD_ALPHA);
+    assert(bmp.palette[3 * 4 + 3] == 0);
+    bmpread_free(&plain);
+    bmpread_ctx_free(p_reuse);
+
+    /* Statistics leave alpha out along with the output. */
+    assert(bmpread(test_bitmaps[8], BMPREAD_ALPHA | BMPREAD_ALPHA_FIRST |
+                                    BMPREAD_DROP_OPAQUE_ALPHA | BMPREAD_STATS,
+                   &bmp));
+    assert(!(bmp.flags & BMPREAD_ALPHA));
+    assert(bmpread(test_bitmaps[8], 0, &opaque));
+    CheckStats(bmp.stats, &opaque);
+    bmpread_free(&opaque);
+    bmpread_free(&bmp);
+
+    /* Padding and resized images go by the image. */
+    assert(bmpread_region(test_bitmaps[6], BMPREAD_PAD_POW2 | BMPREAD_ALPHA |
+                                           BMPREAD_DROP_OPAQUE_ALPHA,
+                          3, 5, 37, 100, &bmp));
+    assert(bmpread_region(test_bitmaps[6], BMPREAD_PAD_POW2, 3, 5, 37, 100,
+                          &opaque));
+    bmp.flags &= ~BMPREAD_DROP_OPAQUE_ALPHA;
+    CheckSameOutput(&bmp, &opaque);
+    bmpread_free(&opaque);
+    bmpread_free(&bmp);
+
+    assert(bmpread_resized(test_bitmaps[8], BMPREAD_ANY_SIZE | BMPREAD_ALPHA |
+                                            BMPREAD_DROP_OPAQUE_ALPHA,
+                           100, 37, &bmp));
+    assert(!(bmp.flags & BMPREAD_ALPHA));
+    bmpread_free(&bmp);
+
+    /* Caller memory is compacted in place. */
+    assert((fp = fopen(test_bitmaps[8], "rb")));
+    assert(bmpread_into(fp, BMPREAD_ALPHA | BMPREAD_DROP_OPAQUE_ALPHA,
+                        scratch, sizeof(scratch), data, sizeof(data), &bmp));
+    assert(bmpread(test_bitmaps[8], 0, &opaque));
+    bmp.flags &= ~BMPREAD_DROP_OPAQUE_ALPHA;
+    CheckSameOutput(&bmp, &opaque);
+    bmpread_free(&opaque);
+    fclose(fp);
+
+    /* Checksums can't be taken of alpha that might be dropped after, but
+     * without BMPREAD_ALPHA there's none to drop.
+     */
+    assert(!bmpread(test_bitmaps[8], BMPREAD_ALPHA | BMPREAD_CHECKSUM |
+                                     BMPREAD_DROP_OPAQUE_ALPHA, &bmp));
+    assert(bmpread(test_bitmaps[8], BMPREAD_CHECKSUM |
+                                    BMPREAD_DROP_OPAQUE_ALPHA, &bmp));
+    assert(bmpread(test_bitmaps[8], BMPREAD_CHECKSUM, &opaque));
+    assert(bmp.checksum == opaque.checksum);
+    bmpread_free(&opaque);
+    bmpread_free(&bmp);
+    assert(!bmpread_open(test_bitmaps[6], BMPREAD_DROP_OPAQUE_ALPHA, &bmp));
+    assert(!bmpread_tiles_open(test_bitmaps[6], BMPREAD_DROP_OPAQUE_ALPHA, 16,
+                               1 << 16, &bmp));
+    assert(!bmpread_atlas(&test_bitmaps[6], 1, BMPREAD_DROP_OPAQUE_ALPHA, 128,
+                          &bmp, &rect));
+}
+
 int main(int argc, char * argv[])
 {
     printf("%s: running tests\n", argv[0]);
@@ -331,8 +3417,38 @@ int main(int argc, char * argv[])
     TEST(IsPowerOf2);
     TEST(GetLineLength);
     TEST(Make8Bits);
+    TEST(Linearize);
     TEST(LoadLittleUint32);
     TEST(LoadLittleUint16);
+    TEST(ValidateInPlace);
+    TEST(BMPREAD_BGR);
+    TEST(BMPREAD_ALPHA_FIRST);
+    TEST(BMPREAD_GRAY);
+    TEST(BMPREAD_INDEXED);
+    TEST(BMPREAD_PLANAR);
+    TEST(BMPREAD_UINT16);
+    TEST(BMPREAD_LINEAR);
+    TEST(Premultiply);
+    TEST(BMPREAD_PREMULTIPLY);
+    TEST(bmpread_ctx_read);
+    TEST(bmpread_ctx_set_lut);
+    TEST(bmpread_ctx_set_color_key);
+    TEST(plain_output);
+    TEST(bmpread_set_allocator);
+    TEST(bmpread_into);
+    TEST(BMPREAD_SCRATCH_SIZE);
+    TEST(bmpread_open);
+    TEST(bmpread_region);
+    TEST(bmpread_resized);
+    TEST(bmpread_atlas);
+    TEST(scaling);
+    TEST(bmpread_tiles_open);
+    TEST(orientation);
+    TEST(BMPREAD_MIPMAPS);
+    TEST(BMPREAD_PAD_POW2);
+    TEST(BMPREAD_CHECKSUM);
+    TEST(BMPREAD_STATS);
+    TEST(BMPREAD_DROP_OPAQUE_ALPHA);
 
 #undef TEST
 